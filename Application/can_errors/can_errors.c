@@ -0,0 +1,159 @@
+/* Includes ================================================================= */
+#include "can_errors.h"
+
+#include "stm32f1xx.h"
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+static can_errors_bus_t buses[CAN_BUS_COUNT];
+
+/* Private functions  ======================================================= */
+
+/**
+ * @brief Derives the error state from the ESR flags.
+ */
+static can_errors_state_t errors_state(uint32_t esr)
+{
+  if (esr & CAN_ERRORS_ESR_BOFF)
+  {
+    return CAN_ERRORS_STATE_BUS_OFF;
+  }
+  if (esr & CAN_ERRORS_ESR_EPVF)
+  {
+    return CAN_ERRORS_STATE_PASSIVE;
+  }
+  if (esr & CAN_ERRORS_ESR_EWGF)
+  {
+    return CAN_ERRORS_STATE_WARNING;
+  }
+
+  return CAN_ERRORS_STATE_ACTIVE;
+}
+
+/* Shared functions ========================================================= */
+void can_errors_reset(void)
+{
+  for (uint8_t bus = 0; bus < CAN_BUS_COUNT; ++bus)
+  {
+    can_errors_bus_t * p_bus = &buses[bus];
+
+    for (uint8_t i = 0; i < CAN_ERRORS_LEC_COUNT; ++i)
+    {
+      p_bus->lec_count[i] = 0;
+    }
+
+    p_bus->suppressed = 0;
+    p_bus->state      = CAN_ERRORS_STATE_ACTIVE;
+    p_bus->tec        = 0;
+    p_bus->rec        = 0;
+    p_bus->tec_max    = 0;
+    p_bus->rec_max    = 0;
+    p_bus->budget     = CAN_ERRORS_TRANSITION_BUDGET;
+    p_bus->changed    = false;
+  }
+}
+
+bool can_errors_update(uint8_t bus, uint32_t esr, can_errors_lec_t lec)
+{
+  if (bus >= CAN_BUS_COUNT)
+  {
+    return false;
+  }
+
+  can_errors_bus_t * p_bus  = &buses[bus];
+  uint8_t            tec    = (uint8_t)(esr >> CAN_ERRORS_ESR_TEC_POS);
+  uint8_t            rec    = (uint8_t)(esr >> CAN_ERRORS_ESR_REC_POS);
+  uint8_t            state  = (uint8_t)errors_state(esr);
+  bool               report = false;
+
+  if ((lec > CAN_ERRORS_LEC_NONE) && (lec < CAN_ERRORS_LEC_COUNT))
+  {
+    p_bus->lec_count[lec]++;
+    p_bus->changed = true;
+  }
+
+  if ((tec != p_bus->tec) || (rec != p_bus->rec))
+  {
+    p_bus->tec     = tec;
+    p_bus->rec     = rec;
+    p_bus->changed = true;
+  }
+  if (tec > p_bus->tec_max)
+  {
+    p_bus->tec_max = tec;
+  }
+  if (rec > p_bus->rec_max)
+  {
+    p_bus->rec_max = rec;
+  }
+
+  if (state != p_bus->state)
+  {
+    p_bus->state   = state;
+    p_bus->changed = true;
+
+    if (p_bus->budget != 0)
+    {
+      p_bus->budget--;
+      report = true;
+    }
+    else
+    {
+      p_bus->suppressed++;
+    }
+  }
+
+  return report;
+}
+
+const can_errors_bus_t * can_errors_get(uint8_t bus)
+{
+  return (bus < CAN_BUS_COUNT) ? &buses[bus] : NULL;
+}
+
+bool can_errors_snapshot(uint8_t bus, can_errors_bus_t * p_snapshot)
+{
+  if ((bus >= CAN_BUS_COUNT) || (p_snapshot == NULL))
+  {
+    return false;
+  }
+
+  /* The error ISR updates the same bus. */
+  __disable_irq();
+  *p_snapshot = buses[bus];
+  __enable_irq();
+
+  return true;
+}
+
+void can_errors_reported(uint8_t bus, const can_errors_bus_t * p_snapshot)
+{
+  if ((bus >= CAN_BUS_COUNT) || (p_snapshot == NULL))
+  {
+    return;
+  }
+
+  can_errors_bus_t * p_bus = &buses[bus];
+  bool               newer;
+
+  __disable_irq();
+
+  /* Anything accounted after the snapshot belongs to the next period. */
+  newer = (p_bus->state != p_snapshot->state) || (p_bus->tec != p_snapshot->tec) ||
+          (p_bus->rec != p_snapshot->rec) || (p_bus->suppressed != p_snapshot->suppressed) ||
+          (p_bus->budget != p_snapshot->budget);
+  for (uint8_t i = 0; i < CAN_ERRORS_LEC_COUNT; ++i)
+  {
+    newer = newer || (p_bus->lec_count[i] != p_snapshot->lec_count[i]);
+  }
+
+  p_bus->changed = newer;
+  p_bus->tec_max = (p_bus->tec_max > p_snapshot->tec_max) ? p_bus->tec_max : p_bus->tec;
+  p_bus->rec_max = (p_bus->rec_max > p_snapshot->rec_max) ? p_bus->rec_max : p_bus->rec;
+  p_bus->budget  = CAN_ERRORS_TRANSITION_BUDGET - (p_snapshot->budget - p_bus->budget);
+
+  __enable_irq();
+}
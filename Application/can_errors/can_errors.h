@@ -0,0 +1,137 @@
+/** ========================================================================= *
+ *
+ * @brief CAN error state telemetry.
+ *
+ * Tracks the bxCAN error counters, the error state and a histogram of last
+ * error codes per bus. Updates come from the error ISR and from periodic
+ * sampling, because leaving error passive or bus-off raises no interrupt.
+ *
+ * State transitions are reported one by one, but only up to
+ * CAN_ERRORS_TRANSITION_BUDGET between two reports, so a bus flapping in and
+ * out of bus-off does not flood the host. Everything else is sent as one
+ * summary per report period.
+ *
+ *  ========================================================================= */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "frame_fifo.h"
+
+/* Macros =================================================================== */
+
+/** Transitions reported between two summaries, the rest is only counted. */
+#define CAN_ERRORS_TRANSITION_BUDGET (8)
+
+/** bxCAN ESR fields. */
+#define CAN_ERRORS_ESR_EWGF      (0x00000001UL)
+#define CAN_ERRORS_ESR_EPVF      (0x00000002UL)
+#define CAN_ERRORS_ESR_BOFF      (0x00000004UL)
+#define CAN_ERRORS_ESR_TEC_POS   (16)
+#define CAN_ERRORS_ESR_REC_POS   (24)
+
+/* Enums ==================================================================== */
+typedef enum {
+	CAN_ERRORS_STATE_ACTIVE = 0, /**< Both counters below 96. */
+	CAN_ERRORS_STATE_WARNING,    /**< A counter reached 96. */
+	CAN_ERRORS_STATE_PASSIVE,    /**< A counter exceeded 127. */
+	CAN_ERRORS_STATE_BUS_OFF     /**< TEC exceeded 255. */
+} can_errors_state_t;
+
+/** Last error codes, same numbering as the bxCAN LEC field. */
+typedef enum {
+	CAN_ERRORS_LEC_NONE = 0,
+	CAN_ERRORS_LEC_STUFF,
+	CAN_ERRORS_LEC_FORM,
+	CAN_ERRORS_LEC_ACK,
+	CAN_ERRORS_LEC_BIT1,  /**< Sent recessive, read dominant. */
+	CAN_ERRORS_LEC_BIT0,  /**< Sent dominant, read recessive. */
+	CAN_ERRORS_LEC_CRC,
+	CAN_ERRORS_LEC_COUNT
+} can_errors_lec_t;
+
+/* Types ==================================================================== */
+
+/**
+ * @brief Error telemetry of one bus.
+ */
+typedef struct
+{
+  uint32_t      lec_count[CAN_ERRORS_LEC_COUNT]; /**< Per code, [0] unused. */
+  uint32_t      suppressed; /**< Transitions over the budget. */
+  uint8_t       state;      /**< See can_errors_state_t. */
+  uint8_t       tec;        /**< Transmit error counter, last sample. */
+  uint8_t       rec;        /**< Receive error counter, last sample. */
+  uint8_t       tec_max;    /**< Highest TEC since the last report. */
+  uint8_t       rec_max;    /**< Highest REC since the last report. */
+  uint8_t       budget;     /**< Transitions left until the next report. */
+  volatile bool changed;    /**< Anything new since the last report. */
+} can_errors_bus_t;
+
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+
+/**
+ * @brief Clears all counters, every bus starts error active.
+ */
+void can_errors_reset(void);
+
+/**
+ * @brief Accounts an error status sample.
+ *
+ * Must not be called concurrently for the same bus.
+ *
+ * @param[in]  bus  Bus, see can_bus_t.
+ * @param[in]  esr  Value of the ESR register.
+ * @param[in]  lec  Error that caused the sample, CAN_ERRORS_LEC_NONE for a
+ *                  periodic sample.
+ *
+ * @return  True if the error state changed and the transition is within the
+ *          budget, so it should be reported.
+ */
+bool can_errors_update(uint8_t bus, uint32_t esr, can_errors_lec_t lec);
+
+/**
+ * @brief Returns the telemetry of a bus.
+ *
+ * @param[in]  bus  Bus, see can_bus_t.
+ *
+ * @return  Pointer to the telemetry, or NULL if bus is out of range.
+ */
+const can_errors_bus_t * can_errors_get(uint8_t bus);
+
+/**
+ * @brief Copies the telemetry of a bus consistently with the error ISR.
+ *
+ * @param[in]  bus         Bus, see can_bus_t.
+ * @param[out] p_snapshot  Copy of the telemetry.
+ *
+ * @return  False if bus is out of range or p_snapshot is NULL.
+ */
+bool can_errors_snapshot(uint8_t bus, can_errors_bus_t * p_snapshot);
+
+/**
+ * @brief Starts a new report period of a bus.
+ *
+ * Clears the changed flag, restarts the counter maximums at the current
+ * values and refills the transition budget. Errors and transitions accounted
+ * after the snapshot was taken stay pending for the next report.
+ *
+ * @param[in]  bus         Bus, see can_bus_t.
+ * @param[in]  p_snapshot  Snapshot the report was made of.
+ */
+void can_errors_reported(uint8_t bus, const can_errors_bus_t * p_snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
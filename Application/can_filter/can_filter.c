@@ -0,0 +1,371 @@
+/* Includes ================================================================= */
+#include "can_filter.h"
+
+/* Defines ================================================================== */
+#define STD_ID_BITS (11)
+#define EXT_ID_BITS (29)
+
+/* IDE bit position in the 16-bit and 32-bit filter layouts. */
+#define FILTER16_IDE (0x0008UL)
+#define FILTER32_IDE (0x0004UL)
+
+/* Macros =================================================================== */
+#define DIV_ROUND_UP(__a, __b) (((__a) + (__b) - 1) / (__b))
+
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+
+/**
+ * @brief Aligned block of 2^size_log2 identifiers.
+ */
+typedef struct
+{
+  uint32_t id;
+  uint8_t  size_log2;
+  bool     ext;
+} filter_block_t;
+
+/**
+ * @brief Amount of blocks of every bank kind.
+ */
+typedef struct
+{
+  size_t std_exact;
+  size_t std_mask;
+  size_t ext_exact;
+  size_t ext_mask;
+} filter_usage_t;
+
+/* Variables ================================================================ */
+/* Private functions  ======================================================= */
+
+/**
+ * @brief Returns true if block a lies within block b.
+ */
+static bool filter_block_within(const filter_block_t * p_a, const filter_block_t * p_b)
+{
+  return (p_a->ext == p_b->ext) && (p_a->size_log2 <= p_b->size_log2) &&
+         ((p_a->id >> p_b->size_log2) == (p_b->id >> p_b->size_log2));
+}
+
+/**
+ * @brief Drops blocks covered by another block.
+ */
+static size_t filter_dedupe(filter_block_t * p_blocks, size_t count)
+{
+  size_t kept = 0;
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    bool covered = false;
+
+    for (size_t j = 0; (j < count) && !covered; ++j)
+    {
+      /* Of two equal blocks only the first one is kept. */
+      covered = (j != i) && filter_block_within(&p_blocks[i], &p_blocks[j]) &&
+                ((p_blocks[i].size_log2 != p_blocks[j].size_log2) || (j < i));
+    }
+
+    if (!covered)
+    {
+      p_blocks[kept++] = p_blocks[i];
+    }
+  }
+
+  return kept;
+}
+
+/**
+ * @brief Splits the rules into aligned blocks.
+ *
+ * @return  Block count, or SIZE_MAX if the rules are invalid or too many
+ *          blocks are needed.
+ */
+static size_t filter_decompose(const can_filter_rule_t * p_rules,
+                               size_t                    rule_count,
+                               filter_block_t *          p_blocks)
+{
+  size_t count = 0;
+
+  for (size_t i = 0; i < rule_count; ++i)
+  {
+    uint32_t id_max = p_rules[i].ext ? CAN_FILTER_EXT_ID_MAX : CAN_FILTER_STD_ID_MAX;
+    uint32_t first  = p_rules[i].first;
+    uint32_t last   = p_rules[i].last;
+
+    if ((first > last) || (last > id_max))
+    {
+      return SIZE_MAX;
+    }
+
+    /* IDs are at most 29 bits, so first + size never overflows. */
+    while (first <= last)
+    {
+      uint8_t size_log2 = 0;
+
+      while (((first & ((2UL << size_log2) - 1)) == 0) &&
+             ((first + (2UL << size_log2) - 1) <= last))
+      {
+        size_log2++;
+      }
+
+      if (count >= CAN_FILTER_MAX_BLOCKS)
+      {
+        return SIZE_MAX;
+      }
+
+      p_blocks[count].id        = first;
+      p_blocks[count].size_log2 = size_log2;
+      p_blocks[count].ext       = p_rules[i].ext;
+      count++;
+
+      first += 1UL << size_log2;
+    }
+  }
+
+  return filter_dedupe(p_blocks, count);
+}
+
+/**
+ * @brief Ignores the low level bits of every block.
+ */
+static size_t filter_widen(filter_block_t * p_blocks, size_t count, uint8_t level)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    uint8_t limit = p_blocks[i].ext ? EXT_ID_BITS : STD_ID_BITS;
+    uint8_t size  = (level > limit) ? limit : level;
+
+    if (p_blocks[i].size_log2 < size)
+    {
+      p_blocks[i].size_log2 = size;
+      p_blocks[i].id       &= ~((1UL << size) - 1);
+    }
+  }
+
+  return filter_dedupe(p_blocks, count);
+}
+
+static filter_usage_t filter_usage(const filter_block_t * p_blocks, size_t count)
+{
+  filter_usage_t usage = { 0, 0, 0, 0 };
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    bool exact = (p_blocks[i].size_log2 == 0);
+
+    if (p_blocks[i].ext)
+    {
+      usage.ext_exact += exact ? 1 : 0;
+      usage.ext_mask  += exact ? 0 : 1;
+    }
+    else
+    {
+      usage.std_exact += exact ? 1 : 0;
+      usage.std_mask  += exact ? 0 : 1;
+    }
+  }
+
+  return usage;
+}
+
+static size_t filter_bank_need(const filter_block_t * p_blocks, size_t count)
+{
+  filter_usage_t usage = filter_usage(p_blocks, count);
+
+  return DIV_ROUND_UP(usage.std_exact, 4) + DIV_ROUND_UP(usage.std_mask, 2) +
+         DIV_ROUND_UP(usage.ext_exact, 2) + usage.ext_mask;
+}
+
+static uint32_t filter_std16(uint32_t id)
+{
+  return (id & CAN_FILTER_STD_ID_MAX) << 5;
+}
+
+static uint32_t filter_std16_mask(uint8_t size_log2)
+{
+  return ((CAN_FILTER_STD_ID_MAX << size_log2) & CAN_FILTER_STD_ID_MAX) << 5 | FILTER16_IDE;
+}
+
+static uint32_t filter_ext32(uint32_t id)
+{
+  return ((id & CAN_FILTER_EXT_ID_MAX) << 3) | FILTER32_IDE;
+}
+
+static uint32_t filter_ext32_mask(uint8_t size_log2)
+{
+  return ((CAN_FILTER_EXT_ID_MAX << size_log2) & CAN_FILTER_EXT_ID_MAX) << 3 | FILTER32_IDE;
+}
+
+/**
+ * @brief Packs all blocks of one kind into bank images.
+ *
+ * Every bank takes four 16-bit words (list 16) or two 32-bit words (ID/mask
+ * pairs, list 32, or ID and mask for mask 32). Unused words of the last bank
+ * repeat the previous filter, which matches nothing new.
+ *
+ * @return  Index of the next free bank.
+ */
+static size_t filter_emit(const filter_block_t * p_blocks,
+                          size_t                 count,
+                          can_filter_mode_t      mode,
+                          can_filter_bank_t *    p_banks,
+                          size_t                 bank_index)
+{
+  bool     ext      = (mode == CAN_FILTER_BANK_LIST32) || (mode == CAN_FILTER_BANK_MASK32);
+  bool     exact    = (mode == CAN_FILTER_BANK_LIST16) || (mode == CAN_FILTER_BANK_LIST32);
+  uint8_t  per_bank = (mode == CAN_FILTER_BANK_LIST16) ? 4 : 2;
+  uint32_t words[4];
+  uint8_t  used = 0;
+
+  for (size_t i = 0; i <= count; ++i)
+  {
+    if (i < count)
+    {
+      const filter_block_t * p_block = &p_blocks[i];
+
+      if ((p_block->ext != ext) || ((p_block->size_log2 == 0) != exact))
+      {
+        continue;
+      }
+
+      switch (mode)
+      {
+        case CAN_FILTER_BANK_LIST16:
+          words[used++] = filter_std16(p_block->id);
+          break;
+
+        case CAN_FILTER_BANK_MASK16:
+          words[used++] = filter_std16(p_block->id) | (filter_std16_mask(p_block->size_log2) << 16);
+          break;
+
+        case CAN_FILTER_BANK_LIST32:
+          words[used++] = filter_ext32(p_block->id);
+          break;
+
+        case CAN_FILTER_BANK_MASK32:
+          words[used++] = filter_ext32(p_block->id);
+          words[used++] = filter_ext32_mask(p_block->size_log2);
+          break;
+      }
+    }
+
+    if ((used == per_bank) || ((i == count) && (used != 0)))
+    {
+      can_filter_bank_t * p_bank = &p_banks[bank_index];
+
+      for (uint8_t j = used; j < per_bank; ++j)
+      {
+        words[j] = words[used - 1];
+      }
+
+      p_bank->mode     = (uint8_t)mode;
+      p_bank->fifo     = (uint8_t)(bank_index & 1);
+      p_bank->reserved = 0;
+
+      if (mode == CAN_FILTER_BANK_LIST16)
+      {
+        p_bank->fr1 = words[0] | (words[1] << 16);
+        p_bank->fr2 = words[2] | (words[3] << 16);
+      }
+      else
+      {
+        p_bank->fr1 = words[0];
+        p_bank->fr2 = words[1];
+      }
+
+      bank_index++;
+      used = 0;
+    }
+  }
+
+  return bank_index;
+}
+
+/* Shared functions ========================================================= */
+can_filter_status_t can_filter_compile(const can_filter_rule_t * p_rules,
+                                       size_t                    rule_count,
+                                       can_filter_bank_t *       p_banks,
+                                       size_t                    max_banks,
+                                       size_t *                  p_bank_count)
+{
+  filter_block_t      blocks[CAN_FILTER_MAX_BLOCKS];
+  can_filter_status_t status = CAN_FILTER_OK;
+  size_t              count;
+
+  if (((p_rules == NULL) && (rule_count != 0)) || (p_banks == NULL) || (p_bank_count == NULL))
+  {
+    return CAN_FILTER_E_NULL;
+  }
+
+  for (size_t i = 0; i < rule_count; ++i)
+  {
+    uint32_t id_max = p_rules[i].ext ? CAN_FILTER_EXT_ID_MAX : CAN_FILTER_STD_ID_MAX;
+
+    if ((p_rules[i].first > p_rules[i].last) || (p_rules[i].last > id_max))
+    {
+      return CAN_FILTER_E_INVAL;
+    }
+  }
+
+  count = filter_decompose(p_rules, rule_count, blocks);
+  if (count == SIZE_MAX)
+  {
+    return CAN_FILTER_E_NOSPACE;
+  }
+
+  for (uint8_t level = 1; filter_bank_need(blocks, count) > max_banks; ++level)
+  {
+    if (level > EXT_ID_BITS)
+    {
+      return CAN_FILTER_E_NOSPACE;
+    }
+
+    count  = filter_widen(blocks, count, level);
+    status = CAN_FILTER_WIDENED;
+  }
+
+  size_t bank_index = 0;
+  bank_index = filter_emit(blocks, count, CAN_FILTER_BANK_LIST16, p_banks, bank_index);
+  bank_index = filter_emit(blocks, count, CAN_FILTER_BANK_MASK16, p_banks, bank_index);
+  bank_index = filter_emit(blocks, count, CAN_FILTER_BANK_LIST32, p_banks, bank_index);
+  bank_index = filter_emit(blocks, count, CAN_FILTER_BANK_MASK32, p_banks, bank_index);
+
+  *p_bank_count = bank_index;
+  return status;
+}
+
+size_t can_filter_count_banks(const can_filter_rule_t * p_rules, size_t rule_count)
+{
+  filter_block_t blocks[CAN_FILTER_MAX_BLOCKS];
+  size_t         count;
+
+  if ((p_rules == NULL) && (rule_count != 0))
+  {
+    return SIZE_MAX;
+  }
+
+  count = filter_decompose(p_rules, rule_count, blocks);
+
+  return (count == SIZE_MAX) ? SIZE_MAX : filter_bank_need(blocks, count);
+}
+
+size_t can_filter_split(size_t can1_banks, size_t can2_banks)
+{
+  const size_t half = CAN_FILTER_BANK_COUNT / 2;
+
+  if ((can1_banks + can2_banks) <= CAN_FILTER_BANK_COUNT)
+  {
+    return can1_banks;
+  }
+  if (can1_banks <= half)
+  {
+    return can1_banks;
+  }
+  if (can2_banks <= half)
+  {
+    return CAN_FILTER_BANK_COUNT - can2_banks;
+  }
+
+  return half;
+}
@@ -0,0 +1,142 @@
+/** ========================================================================= *
+ *
+ * @brief bxCAN acceptance filter compiler.
+ *
+ * Turns a set of identifiers and identifier ranges into filter bank register
+ * values. Ranges are split into aligned power-of-two blocks, single standard
+ * IDs are packed four per bank in 16-bit list mode, standard blocks two per
+ * bank in 16-bit mask mode, single extended IDs two per bank in 32-bit list
+ * mode and extended blocks one per bank in 32-bit mask mode.
+ *
+ * If the exact set needs more banks than available, blocks are widened level
+ * by level (low ID bits ignored) until it fits. Widened filters pass a
+ * superset of the requested IDs.
+ *
+ * The module has no hardware dependencies, so it can be built and tested on
+ * a host.
+ *
+ *  ========================================================================= */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Macros =================================================================== */
+
+/** Filter banks shared by CAN1 and CAN2. */
+#define CAN_FILTER_BANK_COUNT (28)
+
+/** Most blocks a rule set may decompose into. */
+#define CAN_FILTER_MAX_BLOCKS (4 * CAN_FILTER_BANK_COUNT)
+
+#define CAN_FILTER_STD_ID_MAX (0x7FFUL)
+#define CAN_FILTER_EXT_ID_MAX (0x1FFFFFFFUL)
+
+/* Enums ==================================================================== */
+typedef enum {
+	CAN_FILTER_OK = 0,    /**< Set fits exactly. */
+	CAN_FILTER_WIDENED,   /**< Set fits only as a superset of the IDs. */
+	CAN_FILTER_E_NOSPACE, /**< Set does not fit at all. */
+	CAN_FILTER_E_NULL,    /**< NULL pointer argument. */
+	CAN_FILTER_E_INVAL    /**< Rule out of the ID range or reversed. */
+} can_filter_status_t;
+
+typedef enum {
+	CAN_FILTER_BANK_LIST16 = 0, /**< Four standard IDs. */
+	CAN_FILTER_BANK_MASK16,     /**< Two standard ID/mask pairs. */
+	CAN_FILTER_BANK_LIST32,     /**< Two extended IDs. */
+	CAN_FILTER_BANK_MASK32      /**< One ID/mask pair. */
+} can_filter_mode_t;
+
+/* Types ==================================================================== */
+
+/**
+ * @brief Range of identifiers to accept, a single ID has first == last.
+ */
+typedef struct
+{
+  uint32_t first; /**< First identifier of the range. */
+  uint32_t last;  /**< Last identifier of the range, inclusive. */
+  bool     ext;   /**< True for extended (29-bit) identifiers. */
+} can_filter_rule_t;
+
+/**
+ * @brief Register image of one filter bank.
+ *
+ * List modes match data frames only (RTR bit must be 0), mask modes accept
+ * data and remote frames.
+ */
+typedef struct
+{
+  uint8_t  mode;     /**< See can_filter_mode_t. */
+  uint8_t  fifo;     /**< Assigned RX FIFO, 0 or 1. */
+  uint16_t reserved; /**< Padding. */
+  uint32_t fr1;      /**< Filter register 1 value. */
+  uint32_t fr2;      /**< Filter register 2 value. */
+} can_filter_bank_t;
+
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+
+/**
+ * @brief Compiles a rule set into filter banks.
+ *
+ * Consecutive banks are assigned to FIFO0 and FIFO1 in turn, so traffic is
+ * shared by both hardware FIFOs.
+ *
+ * @param[in]  p_rules       Rules, may be NULL if rule_count is 0.
+ * @param[in]  rule_count    Amount of rules.
+ * @param[out] p_banks       Bank images, max_banks long.
+ * @param[in]  max_banks     Banks available.
+ * @param[out] p_bank_count  Banks used.
+ *
+ * @retval CAN_FILTER_OK         If the set fits exactly.
+ * @retval CAN_FILTER_WIDENED    If the set had to be widened to fit.
+ * @retval CAN_FILTER_E_NOSPACE  If the set does not fit, or decomposes into
+ *                               more than CAN_FILTER_MAX_BLOCKS blocks.
+ * @retval CAN_FILTER_E_NULL     If a NULL pointer is provided.
+ * @retval CAN_FILTER_E_INVAL    If a rule is invalid.
+ */
+can_filter_status_t can_filter_compile(const can_filter_rule_t * p_rules,
+                                       size_t                    rule_count,
+                                       can_filter_bank_t *       p_banks,
+                                       size_t                    max_banks,
+                                       size_t *                  p_bank_count);
+
+/**
+ * @brief Returns the amount of banks the exact rule set needs.
+ *
+ * @param[in]  p_rules     Rules.
+ * @param[in]  rule_count  Amount of rules.
+ *
+ * @return  Bank count, or SIZE_MAX if the set is invalid or decomposes into
+ *          too many blocks.
+ */
+size_t can_filter_count_banks(const can_filter_rule_t * p_rules, size_t rule_count);
+
+/**
+ * @brief Splits the shared banks between CAN1 and CAN2.
+ *
+ * Both sides get their exact need if the sum fits. Otherwise a side needing
+ * at most half of the banks keeps its need and the other side gets the rest,
+ * or both get half and are widened.
+ *
+ * @param[in]  can1_banks  Banks needed by CAN1.
+ * @param[in]  can2_banks  Banks needed by CAN2.
+ *
+ * @return  Banks given to CAN1, which is also the first bank of CAN2.
+ */
+size_t can_filter_split(size_t can1_banks, size_t can2_banks);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,392 @@
+/** ========================================================================= *
+ *
+ * @brief Host test of the bxCAN filter compiler.
+ *
+ * Compiles random rule sets, runs every identifier through a model of the
+ * bxCAN acceptance filter loaded with the bank images and compares the
+ * result with a brute force match against the rules.
+ *
+ * Usage: test_can_filter [seed]
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "can_filter.h"
+
+/* Defines ================================================================== */
+#define RANDOM_SETS     (20000)
+#define RULES_MAX       (12)
+#define EXT_SAMPLES     (2048)
+
+/* Macros =================================================================== */
+#define CHECK(__cond)                                                         \
+  do                                                                          \
+  {                                                                           \
+    if (!(__cond))                                                            \
+    {                                                                         \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #__cond);       \
+      failures++;                                                             \
+    }                                                                         \
+  } while (0)
+
+/* Variables ================================================================ */
+static unsigned int failures;
+static uint32_t     random_state = 1;
+
+/* Private functions  ======================================================= */
+
+static uint32_t random_next(void)
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+/**
+ * @brief Frame identifier in the 32-bit filter layout.
+ *
+ * STID[10:0] in bits 31..21, EXID[17:0] in 20..3, IDE bit 2, RTR bit 1.
+ */
+static uint32_t frame_word32(uint32_t id, bool ext, bool rtr)
+{
+  return (ext ? ((id << 3) | 0x4) : (id << 21)) | (rtr ? 0x2 : 0);
+}
+
+/**
+ * @brief Frame identifier in the 16-bit filter layout.
+ *
+ * STID[10:0] in bits 15..5, RTR bit 4, IDE bit 3, EXID[17:15] in 2..0.
+ */
+static uint32_t frame_word16(uint32_t id, bool ext, bool rtr)
+{
+  uint32_t stid = ext ? (id >> 18) : id;
+
+  return ((stid & 0x7FF) << 5) | (rtr ? 0x10 : 0) | (ext ? 0x8 : 0) |
+         (ext ? ((id >> 15) & 0x7) : 0);
+}
+
+/**
+ * @brief Model of the acceptance filter, true if any bank passes the frame.
+ */
+static bool filter_accepts(const can_filter_bank_t * p_banks,
+                           size_t                    bank_count,
+                           uint32_t                  id,
+                           bool                      ext,
+                           bool                      rtr)
+{
+  uint32_t w32 = frame_word32(id, ext, rtr);
+  uint32_t w16 = frame_word16(id, ext, rtr);
+
+  for (size_t i = 0; i < bank_count; ++i)
+  {
+    const can_filter_bank_t * p_bank = &p_banks[i];
+    uint32_t                  fr1    = p_bank->fr1;
+    uint32_t                  fr2    = p_bank->fr2;
+    bool                      match  = false;
+
+    switch (p_bank->mode)
+    {
+      case CAN_FILTER_BANK_LIST16:
+        match = (w16 == (fr1 & 0xFFFF)) || (w16 == (fr1 >> 16)) ||
+                (w16 == (fr2 & 0xFFFF)) || (w16 == (fr2 >> 16));
+        break;
+
+      case CAN_FILTER_BANK_MASK16:
+        match = (((w16 ^ fr1) & (fr1 >> 16)) == 0) || (((w16 ^ fr2) & (fr2 >> 16)) == 0);
+        break;
+
+      case CAN_FILTER_BANK_LIST32:
+        match = (w32 == fr1) || (w32 == fr2);
+        break;
+
+      case CAN_FILTER_BANK_MASK32:
+        match = ((w32 ^ fr1) & fr2) == 0;
+        break;
+
+      default:
+        CHECK(false);
+        break;
+    }
+
+    if (match)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Brute force reference, true if a rule contains the identifier.
+ */
+static bool rules_contain(const can_filter_rule_t * p_rules,
+                          size_t                    rule_count,
+                          uint32_t                  id,
+                          bool                      ext)
+{
+  for (size_t i = 0; i < rule_count; ++i)
+  {
+    if ((p_rules[i].ext == ext) && (id >= p_rules[i].first) && (id <= p_rules[i].last))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Checks one identifier, data frames of wanted IDs must pass, nothing
+ *        else unless the set was widened.
+ */
+static void check_id(const can_filter_rule_t * p_rules,
+                     size_t                    rule_count,
+                     const can_filter_bank_t * p_banks,
+                     size_t                    bank_count,
+                     can_filter_status_t       status,
+                     uint32_t                  id,
+                     bool                      ext)
+{
+  bool wanted = rules_contain(p_rules, rule_count, id, ext);
+  bool data   = filter_accepts(p_banks, bank_count, id, ext, false);
+  bool remote = filter_accepts(p_banks, bank_count, id, ext, true);
+
+  if (wanted && !data)
+  {
+    printf("missed %s ID %lX\n", ext ? "ext" : "std", (unsigned long)id);
+    failures++;
+  }
+  if ((status == CAN_FILTER_OK) && !wanted && (data || remote))
+  {
+    printf("passed %s ID %lX\n", ext ? "ext" : "std", (unsigned long)id);
+    failures++;
+  }
+}
+
+/**
+ * @brief Random range, mostly short ones so exact sets are common.
+ */
+static can_filter_rule_t random_rule(void)
+{
+  can_filter_rule_t rule;
+  uint32_t          id_max = CAN_FILTER_STD_ID_MAX;
+  uint32_t          span;
+
+  rule.ext = (random_next() % 3) == 0;
+  if (rule.ext)
+  {
+    id_max = CAN_FILTER_EXT_ID_MAX;
+  }
+
+  switch (random_next() % 4)
+  {
+    case 0:
+    case 1:  span = 0; break;
+    case 2:  span = random_next() % 16; break;
+    default: span = random_next() >> (random_next() % 32); break;
+  }
+
+  rule.first = random_next() & id_max;
+  rule.last  = ((id_max - rule.first) < span) ? id_max : (rule.first + span);
+
+  return rule;
+}
+
+static void test_random(void)
+{
+  unsigned long exact_count   = 0;
+  unsigned long widened_count = 0;
+  unsigned long nospace_count = 0;
+
+  for (uint32_t n = 0; n < RANDOM_SETS; ++n)
+  {
+    can_filter_rule_t   rules[RULES_MAX];
+    can_filter_bank_t   banks[CAN_FILTER_BANK_COUNT];
+    size_t              rule_count = random_next() % (RULES_MAX + 1);
+    size_t              max_banks  = 1 + (random_next() % CAN_FILTER_BANK_COUNT);
+    size_t              bank_count = SIZE_MAX;
+    bool                has_std    = false;
+    bool                has_ext    = false;
+    can_filter_status_t status;
+
+    for (size_t i = 0; i < rule_count; ++i)
+    {
+      rules[i] = random_rule();
+      has_std |= !rules[i].ext;
+      has_ext |= rules[i].ext;
+    }
+
+    size_t need = can_filter_count_banks(rules, rule_count);
+
+    status = can_filter_compile(rules, rule_count, banks, max_banks, &bank_count);
+
+    if (status == CAN_FILTER_E_NOSPACE)
+    {
+      /* Only too many blocks, or one bank for both ID kinds, cannot fit. */
+      CHECK((need == SIZE_MAX) || (has_std && has_ext && (max_banks < 2)));
+      nospace_count++;
+      continue;
+    }
+
+    CHECK((status == CAN_FILTER_OK) || (status == CAN_FILTER_WIDENED));
+    CHECK(bank_count <= max_banks);
+    CHECK((status == CAN_FILTER_OK) == (need <= max_banks));
+    CHECK((status != CAN_FILTER_OK) || (bank_count == need));
+    for (size_t i = 0; i < bank_count; ++i)
+    {
+      CHECK(banks[i].fifo == (i & 1));
+    }
+
+    exact_count   += (status == CAN_FILTER_OK) ? 1 : 0;
+    widened_count += (status == CAN_FILTER_WIDENED) ? 1 : 0;
+
+    /* Every standard ID. */
+    for (uint32_t id = 0; id <= CAN_FILTER_STD_ID_MAX; ++id)
+    {
+      check_id(rules, rule_count, banks, bank_count, status, id, false);
+    }
+
+    /* Extended IDs around every rule boundary, then random ones. */
+    for (size_t i = 0; i < rule_count; ++i)
+    {
+      uint32_t edges[] = { rules[i].first - 1, rules[i].first, rules[i].last,
+                           rules[i].last + 1 };
+
+      for (size_t j = 0; j < (sizeof(edges) / sizeof(edges[0])); ++j)
+      {
+        if (edges[j] <= CAN_FILTER_EXT_ID_MAX)
+        {
+          check_id(rules, rule_count, banks, bank_count, status, edges[j], true);
+        }
+      }
+    }
+    for (uint32_t i = 0; i < EXT_SAMPLES; ++i)
+    {
+      uint32_t id = random_next() & CAN_FILTER_EXT_ID_MAX;
+
+      /* Half of the samples inside a rule. */
+      if ((rule_count != 0) && (i & 1))
+      {
+        const can_filter_rule_t * p_rule = &rules[random_next() % rule_count];
+
+        id = p_rule->first + (random_next() % (p_rule->last - p_rule->first + 1));
+        check_id(rules, rule_count, banks, bank_count, status, id, p_rule->ext);
+      }
+      else
+      {
+        check_id(rules, rule_count, banks, bank_count, status, id, true);
+      }
+    }
+  }
+
+  printf("%lu exact, %lu widened, %lu without space\n", exact_count, widened_count,
+         nospace_count);
+  CHECK((exact_count != 0) && (widened_count != 0));
+}
+
+static void test_packing(void)
+{
+  can_filter_rule_t rules[] = {
+    { 0x100, 0x100, false }, { 0x101, 0x101, false }, { 0x200, 0x200, false },
+    { 0x7FF, 0x7FF, false }, { 0x300, 0x30F, false }, { 0x18DAF110, 0x18DAF110, true },
+    { 0x18DAF111, 0x18DAF111, true }, { 0x18DB0000, 0x18DBFFFF, true }
+  };
+  can_filter_bank_t banks[CAN_FILTER_BANK_COUNT];
+  size_t            bank_count;
+
+  /* One bank of every kind. */
+  CHECK(can_filter_count_banks(rules, 8) == 4);
+  CHECK(can_filter_compile(rules, 8, banks, CAN_FILTER_BANK_COUNT, &bank_count) == CAN_FILTER_OK);
+  CHECK(bank_count == 4);
+  CHECK(banks[0].mode == CAN_FILTER_BANK_LIST16);
+  CHECK(banks[1].mode == CAN_FILTER_BANK_MASK16);
+  CHECK(banks[2].mode == CAN_FILTER_BANK_LIST32);
+  CHECK(banks[3].mode == CAN_FILTER_BANK_MASK32);
+
+  /* Everything, the whole ID space collapses into two mask banks. */
+  can_filter_rule_t all[] = { { 0, CAN_FILTER_STD_ID_MAX, false },
+                              { 0, CAN_FILTER_EXT_ID_MAX, true } };
+
+  CHECK(can_filter_compile(all, 2, banks, 2, &bank_count) == CAN_FILTER_OK);
+  CHECK(bank_count == 2);
+  CHECK(can_filter_compile(all, 2, banks, 1, &bank_count) == CAN_FILTER_E_NOSPACE);
+
+  /* No rules, no banks. */
+  CHECK(can_filter_compile(NULL, 0, banks, CAN_FILTER_BANK_COUNT, &bank_count) == CAN_FILTER_OK);
+  CHECK(bank_count == 0);
+}
+
+static void test_invalid(void)
+{
+  can_filter_rule_t reversed = { 0x200, 0x100, false };
+  can_filter_rule_t std_high = { 0x700, 0x800, false };
+  can_filter_rule_t ext_high = { 0, CAN_FILTER_EXT_ID_MAX + 1, true };
+  can_filter_rule_t rule     = { 0x100, 0x100, false };
+  can_filter_bank_t banks[CAN_FILTER_BANK_COUNT];
+  size_t            bank_count;
+
+  CHECK(can_filter_compile(NULL, 1, banks, 1, &bank_count) == CAN_FILTER_E_NULL);
+  CHECK(can_filter_compile(&rule, 1, NULL, 1, &bank_count) == CAN_FILTER_E_NULL);
+  CHECK(can_filter_compile(&rule, 1, banks, 1, NULL) == CAN_FILTER_E_NULL);
+  CHECK(can_filter_compile(&reversed, 1, banks, 1, &bank_count) == CAN_FILTER_E_INVAL);
+  CHECK(can_filter_compile(&std_high, 1, banks, 1, &bank_count) == CAN_FILTER_E_INVAL);
+  CHECK(can_filter_compile(&ext_high, 1, banks, 1, &bank_count) == CAN_FILTER_E_INVAL);
+  CHECK(can_filter_count_banks(&reversed, 1) == SIZE_MAX);
+  CHECK(can_filter_count_banks(NULL, 1) == SIZE_MAX);
+}
+
+static void test_split(void)
+{
+  static const size_t cases[][3] = {
+    /* CAN1, CAN2, banks of CAN1 */
+    { 0, 0, 0 },   { 0, 28, 0 },  { 28, 0, 28 },  { 0, 40, 0 },   { 40, 0, 28 },
+    { 10, 18, 10 }, { 20, 10, 18 }, { 10, 20, 10 }, { 14, 30, 14 }, { 20, 20, 14 },
+    { 28, 28, 14 }
+  };
+
+  for (size_t i = 0; i < (sizeof(cases) / sizeof(cases[0])); ++i)
+  {
+    CHECK(can_filter_split(cases[i][0], cases[i][1]) == cases[i][2]);
+  }
+
+  for (size_t can1 = 0; can1 <= (2 * CAN_FILTER_BANK_COUNT); ++can1)
+  {
+    for (size_t can2 = 0; can2 <= (2 * CAN_FILTER_BANK_COUNT); ++can2)
+    {
+      size_t split = can_filter_split(can1, can2);
+
+      CHECK(split <= CAN_FILTER_BANK_COUNT);
+      if ((can1 + can2) <= CAN_FILTER_BANK_COUNT)
+      {
+        CHECK(split == can1);
+      }
+      /* A side needing at most half never loses banks. */
+      CHECK((can1 > (CAN_FILTER_BANK_COUNT / 2)) || (split >= can1));
+      CHECK((can2 > (CAN_FILTER_BANK_COUNT / 2)) || ((CAN_FILTER_BANK_COUNT - split) >= can2));
+    }
+  }
+}
+
+/* Shared functions ========================================================= */
+int main(int argc, char * argv[])
+{
+  if (argc > 1)
+  {
+    random_state = (uint32_t)strtoul(argv[1], NULL, 0);
+    random_state = random_state ? random_state : 1;
+  }
+  printf("seed %lu\n", (unsigned long)random_state);
+
+  test_invalid();
+  test_packing();
+  test_split();
+  test_random();
+
+  printf("%s, %u failures\n", failures ? "FAILED" : "PASSED", failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+/* Includes ================================================================= */
+#include "can_format.h"
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+static const char hex_digits[16] = "0123456789ABCDEF";
+
+/* Two decimal digits for every value 0..99. */
+static const char dec_pairs[200] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+/* Private functions  ======================================================= */
+
+/**
+ * @brief Renders unsigned decimal, zero padded to at least min_digits.
+ */
+static char * format_dec(char * p_dst, uint32_t value, uint8_t min_digits)
+{
+  char    digits[10];
+  uint8_t count = 0;
+
+  while (value >= 100)
+  {
+    uint32_t pair = value % 100;
+    value /= 100;
+    digits[count++] = dec_pairs[(pair * 2) + 1];
+    digits[count++] = dec_pairs[pair * 2];
+  }
+
+  if (value >= 10)
+  {
+    digits[count++] = dec_pairs[(value * 2) + 1];
+    digits[count++] = dec_pairs[value * 2];
+  }
+  else
+  {
+    digits[count++] = (char)('0' + value);
+  }
+
+  while (count < min_digits)
+  {
+    *p_dst++ = '0';
+    min_digits--;
+  }
+
+  while (count > 0)
+  {
+    *p_dst++ = digits[--count];
+  }
+
+  return p_dst;
+}
+
+/**
+ * @brief Renders unsigned upper case hex without leading zeros.
+ */
+static char * format_hex(char * p_dst, uint32_t value)
+{
+  int shift = 28;
+
+  while ((shift > 0) && (((value >> shift) & 0x0F) == 0))
+  {
+    shift -= 4;
+  }
+
+  for (; shift >= 0; shift -= 4)
+  {
+    *p_dst++ = hex_digits[(value >> shift) & 0x0F];
+  }
+
+  return p_dst;
+}
+
+/**
+ * @brief Renders a byte as two upper case hex digits, preceded by a space.
+ */
+static char * format_byte(char * p_dst, uint8_t byte)
+{
+  p_dst[0] = ' ';
+  p_dst[1] = hex_digits[byte >> 4];
+  p_dst[2] = hex_digits[byte & 0x0F];
+  return &p_dst[3];
+}
+
+/**
+ * @brief Copies a constant string without the terminating NUL.
+ */
+static char * format_str(char * p_dst, const char * p_str)
+{
+  while (*p_str)
+  {
+    *p_dst++ = *p_str++;
+  }
+
+  return p_dst;
+}
+
+/* Shared functions ========================================================= */
+size_t
+can_format_frame(char * p_dst, const char * p_tag, const can_frame_t * p_frame)
+{
+  char * p_pos = p_dst;
+
+  p_pos = format_dec(p_pos, p_frame->timestamp, 8);
+  *p_pos++ = ' ';
+  p_pos = format_str(p_pos, p_tag);
+  p_pos = format_str(p_pos, ": ID=0x");
+  p_pos = format_hex(p_pos, p_frame->id);
+  p_pos = format_str(p_pos, " DLC=");
+  p_pos = format_dec(p_pos, p_frame->dlc, 1);
+
+  for (size_t i = 0; i < sizeof(p_frame->data); ++i)
+  {
+    p_pos = format_byte(p_pos, p_frame->data[i]);
+  }
+
+  *p_pos++ = '\r';
+  *p_pos++ = '\n';
+
+  return (size_t)(p_pos - p_dst);
+}
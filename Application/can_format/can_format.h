@@ -0,0 +1,50 @@
+/** ========================================================================= *
+ *
+ * @brief Allocation-free CAN frame line formatter.
+ *
+ *  ========================================================================= */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdint.h>
+#include <stddef.h>
+
+#include "frame_fifo.h"
+
+/* Macros =================================================================== */
+
+/** Longest line produced by can_format_frame(), including "\r\n". */
+#define CAN_FORMAT_LINE_MAX_LENGTH (64)
+
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+
+/**
+ * @brief Renders the frame as a console text line.
+ *
+ * Output is byte-identical to
+ * "%.8lu <tag>: ID=0x%X DLC=%lu %.2X %.2X %.2X %.2X %.2X %.2X %.2X %.2X\r\n"
+ * but uses lookup tables instead of vsprintf, and is not NUL-terminated.
+ *
+ * @param[out] p_dst    Line buffer, at least CAN_FORMAT_LINE_MAX_LENGTH long.
+ * @param[in]  p_tag    Direction tag of up to five characters, e.g. "RX" or
+ *                      "RX-MS".
+ * @param[in]  p_frame  Frame to render.
+ *
+ * @return  Length of the line in bytes.
+ */
+size_t
+can_format_frame(char * p_dst, const char * p_tag, const can_frame_t * p_frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
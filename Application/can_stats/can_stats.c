@@ -0,0 +1,361 @@
+/* Includes ================================================================= */
+#include "can_stats.h"
+
+/* Defines ================================================================== */
+
+/** Bit times after the CRC that are never stuffed: CRC delimiter, ACK slot,
+ *  ACK delimiter, EOF and intermission. */
+#define FRAME_FIXED_TAIL_BITS (1 + 1 + 1 + 7 + 3)
+
+#define LOAD_WINDOW_US (1000000UL)
+
+/* One bucket always stays empty, so the extended ID probe terminates. */
+_Static_assert(CAN_STATS_MAX_ENTRIES < CAN_STATS_EXT_BUCKETS, "ext hash too small");
+_Static_assert(FAST_FIFO_IS_POWER_OF_TWO(CAN_STATS_EXT_BUCKETS), "ext hash size");
+
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+
+/**
+ * @brief State of the bit-serial frame length calculation.
+ */
+typedef struct
+{
+  uint32_t bits;  /**< Bits fed so far, without stuff bits. */
+  uint32_t stuff; /**< Stuff bits inserted so far. */
+  uint16_t crc;   /**< CRC-15 of the bits fed with bitstream_put_crc(). */
+  uint8_t  level; /**< Level of the current run, 2 before SOF. */
+  uint8_t  run;   /**< Length of the current run. */
+} bitstream_t;
+
+/* Variables ================================================================ */
+
+/* Slot + 1 of every standard HS bus ID, 0 if unseen. */
+static uint8_t           std_map[2048];
+static uint8_t           ext_map[CAN_STATS_EXT_BUCKETS];
+static can_stats_entry_t entries[CAN_STATS_MAX_ENTRIES];
+static size_t            entry_count;
+
+static uint32_t frame_count;
+static uint32_t dropped_count;
+static uint32_t bitrate[CAN_BUS_COUNT] = { 500000, 125000, 125000 };
+static uint32_t window_start;
+static uint32_t window_bits[CAN_BUS_COUNT];
+static bool     window_started;
+static uint16_t bus_load[CAN_BUS_COUNT];
+
+/* Private functions  ======================================================= */
+
+/**
+ * @brief Feeds bits MSB first through the bit stuffing counter.
+ */
+static void bitstream_put(bitstream_t * p_stream, uint32_t value, uint8_t count)
+{
+  while (count--)
+  {
+    uint8_t bit = (uint8_t)((value >> count) & 1);
+
+    p_stream->bits++;
+
+    if (bit != p_stream->level)
+    {
+      p_stream->level = bit;
+      p_stream->run   = 1;
+    }
+    else if (++p_stream->run == 5)
+    {
+      /* Complementary stuff bit starts the next run. */
+      p_stream->stuff++;
+      p_stream->level = (uint8_t)!bit;
+      p_stream->run   = 1;
+    }
+  }
+}
+
+/**
+ * @brief Feeds bits MSB first through the stuffing counter and the CRC-15.
+ */
+static void
+bitstream_put_crc(bitstream_t * p_stream, uint32_t value, uint8_t count)
+{
+  for (uint8_t i = count; i > 0; --i)
+  {
+    uint16_t crc_next = (uint16_t)(((value >> (i - 1)) & 1) ^ (p_stream->crc >> 14));
+
+    p_stream->crc = (uint16_t)((p_stream->crc << 1) & 0x7FFF);
+    if (crc_next & 1)
+    {
+      p_stream->crc ^= 0x4599;
+    }
+  }
+
+  bitstream_put(p_stream, value, count);
+}
+
+/**
+ * @brief Returns the entry of an ID, optionally allocating it.
+ */
+static can_stats_entry_t *
+stats_lookup(uint32_t id, bool ext, uint8_t bus, bool create)
+{
+  uint32_t  key = ext ? (id | CAN_STATS_ID_EXT) : (id & 0x7FF);
+  uint8_t * p_slot;
+
+  if (!ext && (bus == CAN_BUS_HS))
+  {
+    p_slot = &std_map[key];
+  }
+  else
+  {
+    uint32_t bucket = (uint32_t)((key ^ ((uint32_t)bus << 29)) * 2654435761UL) >> 24;
+
+    /* Linear probing, entries are never removed apart from a full reset. */
+    for (uint32_t i = 0; i < CAN_STATS_EXT_BUCKETS; ++i)
+    {
+      p_slot = &ext_map[(bucket + i) & (CAN_STATS_EXT_BUCKETS - 1)];
+      if ((*p_slot == 0) ||
+          ((entries[*p_slot - 1].id == key) && (entries[*p_slot - 1].bus == bus)))
+      {
+        break;
+      }
+    }
+  }
+
+  if (*p_slot != 0)
+  {
+    return &entries[*p_slot - 1];
+  }
+
+  if (!create || (entry_count >= CAN_STATS_MAX_ENTRIES))
+  {
+    return NULL;
+  }
+
+  can_stats_entry_t * p_entry = &entries[entry_count++];
+  *p_slot                     = (uint8_t)entry_count;
+
+  p_entry->id         = key;
+  p_entry->bus        = bus;
+  p_entry->count      = 0;
+  p_entry->period_min = UINT32_MAX;
+  p_entry->period_max = 0;
+  p_entry->period_avg = 0;
+  p_entry->jitter     = 0;
+  p_entry->flags      = 0;
+
+  for (uint8_t i = 0; i < sizeof(p_entry->data); ++i)
+  {
+    p_entry->data[i] = 0;
+  }
+
+  return p_entry;
+}
+
+/* Shared functions ========================================================= */
+void can_stats_reset(void)
+{
+  for (size_t i = 0; i < sizeof(std_map); ++i)
+  {
+    std_map[i] = 0;
+  }
+
+  for (size_t i = 0; i < sizeof(ext_map); ++i)
+  {
+    ext_map[i] = 0;
+  }
+
+  for (uint8_t bus = 0; bus < CAN_BUS_COUNT; ++bus)
+  {
+    window_bits[bus] = 0;
+    bus_load[bus]    = 0;
+  }
+
+  entry_count    = 0;
+  frame_count    = 0;
+  dropped_count  = 0;
+  window_started = false;
+}
+
+void can_stats_set_bitrate(uint8_t bus, uint32_t new_bitrate)
+{
+  if (bus < CAN_BUS_COUNT)
+  {
+    bitrate[bus]     = new_bitrate;
+    window_bits[bus] = 0;
+    bus_load[bus]    = 0;
+  }
+}
+
+bool can_stats_update(const can_frame_t * p_frame, uint32_t heartbeat)
+{
+  bool                ext     = (p_frame->flags & CAN_FRAME_FLAG_IDE) != 0;
+  can_stats_entry_t * p_entry = NULL;
+
+  can_stats_tick(p_frame->timestamp);
+  frame_count++;
+
+  if (p_frame->bus < CAN_BUS_COUNT)
+  {
+    window_bits[p_frame->bus] += can_stats_frame_bits(p_frame);
+    p_entry = stats_lookup(p_frame->id, ext, p_frame->bus, true);
+  }
+
+  if (p_entry == NULL)
+  {
+    dropped_count++;
+    return true;
+  }
+
+  if (p_entry->count != 0)
+  {
+    uint32_t period = p_frame->timestamp - p_entry->last_timestamp;
+
+    if (period < p_entry->period_min)
+    {
+      p_entry->period_min = period;
+    }
+    if (period > p_entry->period_max)
+    {
+      p_entry->period_max = period;
+    }
+
+    if (p_entry->count == 1)
+    {
+      /* Seed the averages with the first period. */
+      p_entry->period_avg = period << CAN_STATS_AVG_SHIFT;
+    }
+    else
+    {
+      uint32_t avg       = p_entry->period_avg >> CAN_STATS_AVG_SHIFT;
+      uint32_t deviation = (period > avg) ? (period - avg) : (avg - period);
+
+      p_entry->period_avg += period - avg;
+      p_entry->jitter     += deviation - (p_entry->jitter >> CAN_STATS_AVG_SHIFT);
+    }
+  }
+
+  bool    rtr     = (p_frame->flags & CAN_FRAME_FLAG_RTR) != 0;
+  uint8_t length  = rtr ? 0 : ((p_frame->dlc > 8) ? 8 : p_frame->dlc);
+  bool    changed = (p_entry->count == 0) || (p_entry->dlc != p_frame->dlc) ||
+                    (p_entry->flags != p_frame->flags);
+
+  for (uint8_t i = 0; i < length; ++i)
+  {
+    changed |= (p_entry->data[i] != p_frame->data[i]);
+    p_entry->data[i] = p_frame->data[i];
+  }
+
+  if (!changed && (heartbeat != 0) &&
+      ((p_frame->timestamp - p_entry->last_forward) >= heartbeat))
+  {
+    changed = true;
+  }
+  if (changed)
+  {
+    p_entry->last_forward = p_frame->timestamp;
+  }
+
+  p_entry->count++;
+  p_entry->last_timestamp = p_frame->timestamp;
+  p_entry->dlc            = p_frame->dlc;
+  p_entry->flags          = p_frame->flags;
+
+  return changed;
+}
+
+void can_stats_tick(uint32_t now)
+{
+  if (!window_started)
+  {
+    window_start   = now;
+    window_started = true;
+    return;
+  }
+
+  uint32_t elapsed = now - window_start;
+
+  /* Timestamps taken in ISR may be slightly older than main loop time. */
+  if ((elapsed < LOAD_WINDOW_US) || (elapsed > (UINT32_MAX / 2)))
+  {
+    return;
+  }
+
+  for (uint8_t bus = 0; bus < CAN_BUS_COUNT; ++bus)
+  {
+    /* Load in 0.1 %: bits * 1000 / (bitrate * elapsed s). */
+    uint64_t capacity = ((uint64_t)bitrate[bus] * elapsed) / 1000000UL;
+    uint64_t load = capacity ? (((uint64_t)window_bits[bus] * 1000) / capacity) : 0;
+
+    bus_load[bus]    = (uint16_t)((load > 1000) ? 1000 : load);
+    window_bits[bus] = 0;
+  }
+
+  window_start = now;
+}
+
+uint16_t can_stats_get_bus_load(uint8_t bus)
+{
+  return (bus < CAN_BUS_COUNT) ? bus_load[bus] : 0;
+}
+
+uint32_t can_stats_get_frame_count(void)
+{
+  return frame_count;
+}
+
+uint32_t can_stats_get_dropped_count(void)
+{
+  return dropped_count;
+}
+
+size_t can_stats_get_size(void)
+{
+  return entry_count;
+}
+
+const can_stats_entry_t * can_stats_get_entry(size_t index)
+{
+  return (index < entry_count) ? &entries[index] : NULL;
+}
+
+const can_stats_entry_t * can_stats_find(uint32_t id, bool ext, uint8_t bus)
+{
+  return stats_lookup(id, ext, bus, false);
+}
+
+uint32_t can_stats_frame_bits(const can_frame_t * p_frame)
+{
+  bitstream_t stream = { .bits = 0, .stuff = 0, .crc = 0, .level = 2, .run = 0 };
+  uint8_t     rtr    = (p_frame->flags & CAN_FRAME_FLAG_RTR) ? 1 : 0;
+  uint8_t     dlc    = p_frame->dlc & 0x0F;
+  uint8_t     length = rtr ? 0 : ((dlc > 8) ? 8 : dlc);
+
+  bitstream_put_crc(&stream, 0, 1); /* SOF */
+
+  if (p_frame->flags & CAN_FRAME_FLAG_IDE)
+  {
+    bitstream_put_crc(&stream, p_frame->id >> 18, 11);
+    bitstream_put_crc(&stream, 0x3, 2); /* SRR, IDE */
+    bitstream_put_crc(&stream, p_frame->id, 18);
+    bitstream_put_crc(&stream, rtr, 1);
+    bitstream_put_crc(&stream, 0, 2); /* r1, r0 */
+  }
+  else
+  {
+    bitstream_put_crc(&stream, p_frame->id, 11);
+    bitstream_put_crc(&stream, rtr, 1);
+    bitstream_put_crc(&stream, 0, 2); /* IDE, r0 */
+  }
+
+  bitstream_put_crc(&stream, dlc, 4);
+
+  for (uint8_t i = 0; i < length; ++i)
+  {
+    bitstream_put_crc(&stream, p_frame->data[i], 8);
+  }
+
+  bitstream_put(&stream, stream.crc, 15);
+
+  return stream.bits + stream.stuff + FRAME_FIXED_TAIL_BITS;
+}
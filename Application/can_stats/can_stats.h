@@ -0,0 +1,182 @@
+/** ========================================================================= *
+ *
+ * @brief Per-ID CAN traffic statistics and bus load.
+ *
+ * Standard IDs of the HS bus are looked up through a 2048 byte direct map,
+ * extended IDs and IDs of the other buses through a small open addressing
+ * hash. Both point into one shared pool of entries, so RAM is only spent on
+ * IDs that are really on the bus. The same ID on two buses is two entries.
+ *
+ * Every entry also keeps the last payload of its ID, so the table tells
+ * whether a frame carries anything new (delta capture) and can be dumped as
+ * a snapshot of the latest values.
+ *
+ *  ========================================================================= */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "frame_fifo.h"
+
+/* Macros =================================================================== */
+
+/** Amount of distinct IDs tracked, at most 255 (slot numbers are bytes). */
+#define CAN_STATS_MAX_ENTRIES (240)
+
+/** Buckets of the extended ID hash, must be a power of two. */
+#define CAN_STATS_EXT_BUCKETS (256)
+
+/** Set in can_stats_entry_t::id for extended (29-bit) identifiers. */
+#define CAN_STATS_ID_EXT (0x80000000UL)
+
+/** Fixed point shift of the averaged values in can_stats_entry_t. */
+#define CAN_STATS_AVG_SHIFT (4)
+
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+
+/**
+ * @brief Statistics of one identifier.
+ *
+ * Inter-arrival times are in microseconds. The average and the jitter (mean
+ * absolute deviation from the average) are exponential moving averages with
+ * a weight of 1/16, kept in fixed point with CAN_STATS_AVG_SHIFT fraction
+ * bits.
+ */
+typedef struct
+{
+  uint32_t id;             /**< Identifier, CAN_STATS_ID_EXT for 29-bit. */
+  uint32_t count;          /**< Frames received. */
+  uint32_t last_timestamp; /**< Timestamp of the last frame. */
+  uint32_t period_min;     /**< Shortest inter-arrival time. */
+  uint32_t period_max;     /**< Longest inter-arrival time. */
+  uint32_t period_avg;     /**< Averaged inter-arrival time, fixed point. */
+  uint32_t jitter;         /**< Averaged deviation, fixed point. */
+  uint32_t last_forward;   /**< Timestamp of the last new or heartbeat frame. */
+  uint8_t  dlc;            /**< DLC of the last frame. */
+  uint8_t  bus;            /**< Source bus, see can_bus_t. */
+  uint8_t  flags;          /**< CAN_FRAME_FLAG_* bits of the last frame. */
+  uint8_t  reserved;       /**< Padding, keeps the payload word aligned. */
+  uint8_t  data[8];        /**< Payload of the last frame. */
+} can_stats_entry_t;
+
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+
+/**
+ * @brief Drops all entries and restarts the bus load measurement.
+ */
+void can_stats_reset(void);
+
+/**
+ * @brief Sets the nominal bitrate the bus load is related to.
+ *
+ * @param[in]  bus      Bus, see can_bus_t.
+ * @param[in]  bitrate  Bitrate in bit/s.
+ */
+void can_stats_set_bitrate(uint8_t bus, uint32_t bitrate);
+
+/**
+ * @brief Accounts a received frame and stores its payload.
+ *
+ * A frame is new if it is the first of its ID, or its DLC, RTR bit or
+ * payload differ from the previous frame of the ID. A repeated frame still
+ * counts as new once heartbeat microseconds have passed since the last new
+ * one, which proves the ID is alive. Frames of IDs that did not fit the
+ * table are always new.
+ *
+ * @param[in]  p_frame    Received frame, timestamp in microseconds.
+ * @param[in]  heartbeat  Heartbeat period in microseconds, 0 for none.
+ *
+ * @return  True if the frame is new.
+ */
+bool can_stats_update(const can_frame_t * p_frame, uint32_t heartbeat);
+
+/**
+ * @brief Closes the bus load window once a second has elapsed.
+ *
+ * Also called from can_stats_update(), so it only matters while the bus is
+ * quiet.
+ *
+ * @param[in]  now  Current time in microseconds.
+ */
+void can_stats_tick(uint32_t now);
+
+/**
+ * @brief Returns the bus load of the last complete one second window.
+ *
+ * @param[in]  bus  Bus, see can_bus_t.
+ *
+ * @return  Bus load in 0.1 % units.
+ */
+uint16_t can_stats_get_bus_load(uint8_t bus);
+
+/**
+ * @brief Returns the amount of frames accounted since the last reset.
+ *
+ * @return  Frame counter.
+ */
+uint32_t can_stats_get_frame_count(void);
+
+/**
+ * @brief Returns the amount of frames whose ID did not fit the table.
+ *
+ * @return  Dropped frame counter.
+ */
+uint32_t can_stats_get_dropped_count(void);
+
+/**
+ * @brief Returns the amount of entries in use.
+ *
+ * @return  Entry count.
+ */
+size_t can_stats_get_size(void);
+
+/**
+ * @brief Returns an entry by its position in the pool.
+ *
+ * Entries are never moved, so the pool can be walked while new IDs are
+ * appended.
+ *
+ * @param[in]  index  Position, below can_stats_get_size().
+ *
+ * @return  Pointer to the entry, or NULL if index is out of range.
+ */
+const can_stats_entry_t * can_stats_get_entry(size_t index);
+
+/**
+ * @brief Returns the entry of an identifier.
+ *
+ * @param[in]  id    Identifier.
+ * @param[in]  ext   True for extended identifiers.
+ * @param[in]  bus   Source bus, see can_bus_t.
+ *
+ * @return  Pointer to the entry, or NULL if the ID has not been seen.
+ */
+const can_stats_entry_t * can_stats_find(uint32_t id, bool ext, uint8_t bus);
+
+/**
+ * @brief Calculates the length of a frame on the wire.
+ *
+ * Includes SOF up to the end of the intermission and the stuff bits of the
+ * actual payload and CRC.
+ *
+ * @param[in]  p_frame  Frame.
+ *
+ * @return  Length in bit times.
+ */
+uint32_t can_stats_frame_bits(const can_frame_t * p_frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
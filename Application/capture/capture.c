@@ -0,0 +1,260 @@
+/* Includes ================================================================= */
+#include "capture.h"
+
+/* Defines ================================================================== */
+_Static_assert(FAST_FIFO_IS_POWER_OF_TWO(CAPTURE_SIZE), "capture size");
+_Static_assert(CAPTURE_TRIGGER_MAX < CAPTURE_SOURCE_NONE, "trigger count");
+
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+static can_frame_t       ring[CAPTURE_SIZE];
+static capture_trigger_t triggers[CAPTURE_TRIGGER_MAX];
+static size_t            trigger_count;
+
+static volatile capture_state_t state;
+static size_t                   pre_count;
+static size_t                   post_count;
+static uint32_t                 freeze_count;
+
+/* Frames written since arming, the ring index is taken from the low bits. */
+static uint32_t write_count;
+static uint32_t trigger_pos;
+static uint32_t window_start;
+
+static capture_window_t window;
+
+/* First error since the last frame, latched by capture_error(). */
+static volatile bool     error_pending;
+static volatile uint32_t error_timestamp;
+static volatile uint8_t  error_bus;
+static volatile uint8_t  error_source;
+
+/* Private functions  ======================================================= */
+
+/**
+ * @brief Returns true if the condition applies to the bus.
+ */
+static bool capture_bus_match(const capture_trigger_t * p_trigger, uint8_t bus)
+{
+  return (p_trigger->bus == CAPTURE_BUS_ANY) || (p_trigger->bus == bus);
+}
+
+/**
+ * @brief Returns the index of the first frame condition matching the frame.
+ */
+static uint8_t capture_match(const can_frame_t * p_frame)
+{
+  bool ext = (p_frame->flags & CAN_FRAME_FLAG_IDE) != 0;
+
+  for (size_t i = 0; i < trigger_count; ++i)
+  {
+    const capture_trigger_t * p_trigger = &triggers[i];
+    bool                      match;
+
+    match = (p_trigger->type == CAPTURE_TRIGGER_FRAME) && (p_trigger->ext == ext) &&
+            capture_bus_match(p_trigger, p_frame->bus) &&
+            (((p_frame->id ^ p_trigger->id) & p_trigger->id_mask) == 0);
+
+    for (uint8_t j = 0; match && (j < sizeof(p_trigger->data)); ++j)
+    {
+      if (p_trigger->data_mask[j] != 0)
+      {
+        match = (j < p_frame->dlc) &&
+                (((p_frame->data[j] ^ p_trigger->data[j]) & p_trigger->data_mask[j]) == 0);
+      }
+    }
+
+    if (match)
+    {
+      return (uint8_t)i;
+    }
+  }
+
+  return CAPTURE_SOURCE_NONE;
+}
+
+/**
+ * @brief Starts the post-trigger part at the next frame written.
+ */
+static void capture_trigger(uint8_t source, uint8_t bus, uint32_t timestamp)
+{
+  trigger_pos      = write_count;
+  window.source    = source;
+  window.bus       = bus;
+  window.timestamp = timestamp;
+  error_pending    = false;
+  state            = CAPTURE_STATE_TRIGGERED;
+}
+
+/* Shared functions ========================================================= */
+void capture_clear_triggers(void)
+{
+  trigger_count = 0;
+}
+
+fifo_error_t capture_add_trigger(const capture_trigger_t * p_trigger)
+{
+  if (p_trigger == NULL)
+  {
+    return E_NULL;
+  }
+  if (trigger_count >= CAPTURE_TRIGGER_MAX)
+  {
+    return E_NOMEM;
+  }
+
+  triggers[trigger_count] = *p_trigger;
+  trigger_count++;
+
+  return E_OK;
+}
+
+size_t capture_get_trigger_count(void)
+{
+  return trigger_count;
+}
+
+fifo_error_t capture_arm(size_t pre, size_t post)
+{
+  if ((post == 0) || (pre > CAPTURE_SIZE) || (post > (CAPTURE_SIZE - pre)))
+  {
+    return E_INVAL;
+  }
+
+  state            = CAPTURE_STATE_IDLE;
+  pre_count        = pre;
+  post_count       = post;
+  write_count      = 0;
+  window.source    = CAPTURE_SOURCE_NONE;
+  window.bus       = 0;
+  window.timestamp = 0;
+  error_pending    = false;
+  state            = CAPTURE_STATE_ARMED;
+
+  return E_OK;
+}
+
+void capture_disarm(void)
+{
+  state = CAPTURE_STATE_IDLE;
+}
+
+void capture_freeze(void)
+{
+  if ((state != CAPTURE_STATE_ARMED) && (state != CAPTURE_STATE_TRIGGERED))
+  {
+    return;
+  }
+
+  if (state == CAPTURE_STATE_ARMED)
+  {
+    trigger_pos = write_count;
+  }
+
+  /* Older frames have been overwritten by the post-trigger part. */
+  window_start = (trigger_pos > pre_count) ? (trigger_pos - pre_count) : 0;
+  if ((write_count - window_start) > CAPTURE_SIZE)
+  {
+    window_start = write_count - CAPTURE_SIZE;
+  }
+
+  window.length  = write_count - window_start;
+  window.trigger = trigger_pos - window_start;
+  freeze_count++;
+  state = CAPTURE_STATE_FROZEN;
+}
+
+void capture_frame(const can_frame_t * p_frame)
+{
+  if (state == CAPTURE_STATE_ARMED)
+  {
+    uint8_t source;
+
+    if (error_pending && ((int32_t)(p_frame->timestamp - error_timestamp) >= 0))
+    {
+      capture_trigger(error_source, error_bus, error_timestamp);
+    }
+    else if ((source = capture_match(p_frame)) != CAPTURE_SOURCE_NONE)
+    {
+      capture_trigger(source, p_frame->bus, p_frame->timestamp);
+    }
+  }
+  else if (state != CAPTURE_STATE_TRIGGERED)
+  {
+    return;
+  }
+
+  ring[write_count & (CAPTURE_SIZE - 1)] = *p_frame;
+  write_count++;
+
+  if ((state == CAPTURE_STATE_TRIGGERED) && ((write_count - trigger_pos) >= post_count))
+  {
+    capture_freeze();
+  }
+}
+
+void capture_error(uint8_t bus, uint32_t timestamp)
+{
+  if ((state != CAPTURE_STATE_ARMED) || error_pending)
+  {
+    return;
+  }
+
+  for (size_t i = 0; i < trigger_count; ++i)
+  {
+    if ((triggers[i].type == CAPTURE_TRIGGER_ERROR) && capture_bus_match(&triggers[i], bus))
+    {
+      error_timestamp = timestamp;
+      error_bus       = bus;
+      error_source    = (uint8_t)i;
+      error_pending   = true;
+      return;
+    }
+  }
+}
+
+void capture_tick(uint32_t now)
+{
+  if ((state == CAPTURE_STATE_ARMED) && error_pending &&
+      ((now - error_timestamp) >= CAPTURE_ERROR_SETTLE_US))
+  {
+    capture_trigger(error_source, error_bus, error_timestamp);
+  }
+}
+
+capture_state_t capture_get_state(void)
+{
+  return state;
+}
+
+uint32_t capture_get_freeze_count(void)
+{
+  return freeze_count;
+}
+
+fifo_error_t capture_get_window(capture_window_t * p_window)
+{
+  if (p_window == NULL)
+  {
+    return E_NULL;
+  }
+  if (state != CAPTURE_STATE_FROZEN)
+  {
+    return E_EMPTY;
+  }
+
+  *p_window = window;
+  return E_OK;
+}
+
+const can_frame_t * capture_get_frame(size_t index)
+{
+  if ((state != CAPTURE_STATE_FROZEN) || (index >= window.length))
+  {
+    return NULL;
+  }
+
+  return &ring[(window_start + index) & (CAPTURE_SIZE - 1)];
+}
@@ -0,0 +1,216 @@
+/** ========================================================================= *
+ *
+ * @brief Pre/post-trigger frame capture.
+ *
+ * While armed, every received frame is written to a RAM ring which always
+ * holds the latest CAPTURE_SIZE frames. Each frame is matched against a set
+ * of trigger conditions (identifier and payload masks, or an error on a bus).
+ * On the first match the capture keeps running until the post-trigger part
+ * of the window is complete, then it freezes, so the window can be dumped
+ * while new traffic is ignored.
+ *
+ * The trigger position is the first frame at or after the trigger: a frame
+ * trigger is the first post-trigger frame, an error trigger lies before the
+ * first frame received after the error.
+ *
+ * Frames are fed from the main loop only, errors may be reported from any
+ * context.
+ *
+ *  ========================================================================= */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "frame_fifo.h"
+
+/* Macros =================================================================== */
+
+/** Frames held by the ring, must be a power of two. 20 kB of RAM. */
+#define CAPTURE_SIZE (1024)
+
+/** Amount of trigger conditions, any one of them triggers. */
+#define CAPTURE_TRIGGER_MAX (8)
+
+/** Matches frames or errors of every bus. */
+#define CAPTURE_BUS_ANY (0xFF)
+
+/** Trigger source of a trigger which has not happened (yet). */
+#define CAPTURE_SOURCE_NONE (0xFF)
+
+/**
+ * Time an error waits for frames received before it, so they still end up in
+ * the pre-trigger part of the window, in microseconds.
+ */
+#define CAPTURE_ERROR_SETTLE_US (1000UL)
+
+/* Enums ==================================================================== */
+typedef enum {
+	CAPTURE_STATE_IDLE = 0,  /**< Not armed, nothing captured. */
+	CAPTURE_STATE_ARMED,     /**< Filling the ring, waiting for a trigger. */
+	CAPTURE_STATE_TRIGGERED, /**< Collecting the post-trigger frames. */
+	CAPTURE_STATE_FROZEN     /**< Window complete, ready to be dumped. */
+} capture_state_t;
+
+typedef enum {
+	CAPTURE_TRIGGER_FRAME = 0, /**< Frame matching identifier and payload. */
+	CAPTURE_TRIGGER_ERROR      /**< Any error reported on the bus. */
+} capture_trigger_type_t;
+
+/* Types ==================================================================== */
+
+/**
+ * @brief Trigger condition.
+ *
+ * A frame matches if (id & id_mask) equals the masked trigger id, the IDE bit
+ * matches, and every payload byte is equal to data[] in the bits set in
+ * data_mask[]. Masked payload bytes past the DLC of the frame never match.
+ */
+typedef struct
+{
+  uint32_t id;           /**< Identifier. */
+  uint32_t id_mask;      /**< Identifier bits compared. */
+  uint8_t  data[8];      /**< Payload. */
+  uint8_t  data_mask[8]; /**< Payload bits compared. */
+  uint8_t  type;         /**< See capture_trigger_type_t. */
+  uint8_t  bus;          /**< Bus, see can_bus_t, or CAPTURE_BUS_ANY. */
+  bool     ext;          /**< Extended identifier. */
+} capture_trigger_t;
+
+/**
+ * @brief Description of a captured window.
+ */
+typedef struct
+{
+  size_t   length;      /**< Frames in the window. */
+  size_t   trigger;     /**< Position of the trigger in the window. */
+  uint32_t timestamp;   /**< Time of the trigger in microseconds, 0 if none. */
+  uint8_t  source;      /**< Index of the condition that matched, or
+                             CAPTURE_SOURCE_NONE. */
+  uint8_t  bus;         /**< Bus of the trigger frame or error. */
+} capture_window_t;
+
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+
+/**
+ * @brief Drops all trigger conditions.
+ */
+void capture_clear_triggers(void);
+
+/**
+ * @brief Adds a trigger condition.
+ *
+ * @param[in]  p_trigger  Condition, copied.
+ *
+ * @retval     E_OK     If the condition was added.
+ * @retval     E_NULL   If p_trigger is NULL.
+ * @retval     E_NOMEM  If CAPTURE_TRIGGER_MAX conditions are set already.
+ */
+fifo_error_t capture_add_trigger(const capture_trigger_t * p_trigger);
+
+/**
+ * @brief Returns the amount of trigger conditions set.
+ *
+ * @return  Condition count.
+ */
+size_t capture_get_trigger_count(void);
+
+/**
+ * @brief Clears the ring and waits for a trigger.
+ *
+ * @param[in]  pre   Frames kept before the trigger position.
+ * @param[in]  post  Frames kept from the trigger position on, at least one.
+ *
+ * @retval     E_OK     If the capture is armed.
+ * @retval     E_INVAL  If post is zero or the window exceeds CAPTURE_SIZE.
+ */
+fifo_error_t capture_arm(size_t pre, size_t post);
+
+/**
+ * @brief Stops the capture and drops the window.
+ */
+void capture_disarm(void);
+
+/**
+ * @brief Freezes the window captured so far.
+ *
+ * Without a trigger the trigger position is the end of the window and the
+ * source is CAPTURE_SOURCE_NONE. Does nothing unless armed or triggered.
+ */
+void capture_freeze(void);
+
+/**
+ * @brief Accounts a received frame.
+ *
+ * @param[in]  p_frame  Frame, timestamp in microseconds.
+ */
+void capture_frame(const can_frame_t * p_frame);
+
+/**
+ * @brief Reports an error, triggers error conditions of the bus.
+ *
+ * Safe to call from ISRs, only the first error until the next frame or tick
+ * is kept.
+ *
+ * @param[in]  bus        Bus, see can_bus_t.
+ * @param[in]  timestamp  Time of the error in microseconds.
+ */
+void capture_error(uint8_t bus, uint32_t timestamp);
+
+/**
+ * @brief Triggers on an error while the bus is quiet.
+ *
+ * @param[in]  now  Current time in microseconds.
+ */
+void capture_tick(uint32_t now);
+
+/**
+ * @brief Returns the capture state.
+ *
+ * @return  See capture_state_t.
+ */
+capture_state_t capture_get_state(void);
+
+/**
+ * @brief Returns how many windows have been frozen since power up.
+ *
+ * Tells a freshly frozen window apart from one which has been dumped.
+ *
+ * @return  Freeze counter.
+ */
+uint32_t capture_get_freeze_count(void);
+
+/**
+ * @brief Describes the frozen window.
+ *
+ * @param[out] p_window  Window description.
+ *
+ * @retval     E_OK     If the window is frozen.
+ * @retval     E_NULL   If p_window is NULL.
+ * @retval     E_EMPTY  If the capture is not frozen.
+ */
+fifo_error_t capture_get_window(capture_window_t * p_window);
+
+/**
+ * @brief Returns a frame of the frozen window.
+ *
+ * @param[in]  index  Position in the window, 0 is the oldest frame.
+ *
+ * @return  Pointer to the frame, or NULL if the capture is not frozen or
+ *          index is out of range.
+ */
+const can_frame_t * capture_get_frame(size_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
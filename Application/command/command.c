@@ -0,0 +1,208 @@
+/* Includes ================================================================= */
+#include "command.h"
+#include <string.h>
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Private functions  ======================================================= */
+
+/**
+ * @brief Returns true for bytes which terminate a line.
+ */
+static bool command_is_eol(uint8_t byte)
+{
+  return (byte == '\r') || (byte == '\n') || (byte == ';');
+}
+
+/**
+ * @brief Returns true for bytes which separate arguments.
+ */
+static bool command_is_separator(char byte)
+{
+  return (byte == ' ') || (byte == ',') || (byte == '\t');
+}
+
+/**
+ * @brief Splits the line in place into NUL-terminated arguments.
+ *
+ * @return  false if the line has more than COMMAND_MAX_ARGS arguments.
+ */
+static bool command_split(char * p_line, char * argv[], uint8_t * p_argc)
+{
+  uint8_t argc = 0;
+
+  while (*p_line)
+  {
+    while (command_is_separator(*p_line))
+    {
+      *p_line++ = '\0';
+    }
+
+    if (*p_line == '\0')
+    {
+      break;
+    }
+    if (argc >= COMMAND_MAX_ARGS)
+    {
+      /* Running the command on a part of its arguments would be wrong. */
+      *p_argc = argc;
+      return false;
+    }
+
+    argv[argc++] = p_line;
+
+    while ((*p_line != '\0') && !command_is_separator(*p_line))
+    {
+      p_line++;
+    }
+  }
+
+  *p_argc = argc;
+  return true;
+}
+
+/**
+ * @brief Reports command result if the callback is set.
+ */
+static void
+command_report(command_ctx_t * p_ctx, const char * p_name, command_status_t status)
+{
+  if (p_ctx->result)
+  {
+    p_ctx->result(p_name, status);
+  }
+}
+
+/* Shared functions ========================================================= */
+void command_init(command_ctx_t *         p_ctx,
+                  const command_entry_t * p_table,
+                  size_t                  table_size,
+                  command_handler_t       fallback,
+                  command_result_t        result)
+{
+  p_ctx->p_table    = p_table;
+  p_ctx->table_size = table_size;
+  p_ctx->fallback   = fallback;
+  p_ctx->result     = result;
+  p_ctx->length     = 0;
+  p_ctx->overflow   = false;
+}
+
+command_status_t command_execute(command_ctx_t * p_ctx, char * p_line)
+{
+  char *           argv[COMMAND_MAX_ARGS];
+  uint8_t          argc;
+  command_status_t status = COMMAND_E_UNKNOWN;
+
+  if (!command_split(p_line, argv, &argc))
+  {
+    command_report(p_ctx, argv[0], COMMAND_E_ARG);
+    return COMMAND_E_ARG;
+  }
+
+  if (argc == 0)
+  {
+    /* Empty line, e.g. "\r\n" sequence. */
+    return COMMAND_OK;
+  }
+
+  for (size_t i = 0; i < p_ctx->table_size; ++i)
+  {
+    if (strcmp(argv[0], p_ctx->p_table[i].name) == 0)
+    {
+      status = p_ctx->p_table[i].handler(argc, argv);
+      command_report(p_ctx, argv[0], status);
+      return status;
+    }
+  }
+
+  if (p_ctx->fallback)
+  {
+    status = p_ctx->fallback(argc, argv);
+  }
+
+  command_report(p_ctx, argv[0], status);
+  return status;
+}
+
+void command_feed(command_ctx_t * p_ctx, const uint8_t * p_data, size_t length)
+{
+  for (size_t i = 0; i < length; ++i)
+  {
+    if (command_is_eol(p_data[i]))
+    {
+      if (p_ctx->overflow)
+      {
+        command_report(p_ctx, "", COMMAND_E_LENGTH);
+      }
+      else
+      {
+        p_ctx->line[p_ctx->length] = '\0';
+        command_execute(p_ctx, p_ctx->line);
+      }
+
+      p_ctx->length   = 0;
+      p_ctx->overflow = false;
+    }
+    else if (p_ctx->length < (COMMAND_LINE_MAX_LENGTH - 1))
+    {
+      p_ctx->line[p_ctx->length++] = (char)p_data[i];
+    }
+    else
+    {
+      /* Drop the rest of the line, it is rejected once terminated. */
+      p_ctx->overflow = true;
+    }
+  }
+}
+
+bool command_parse_uint(const char * p_str, uint32_t * p_value)
+{
+  uint32_t value = 0;
+  uint32_t base  = 10;
+
+  if ((p_str[0] == '0') && ((p_str[1] == 'x') || (p_str[1] == 'X')))
+  {
+    base = 16;
+    p_str += 2;
+  }
+
+  if (*p_str == '\0')
+  {
+    return false;
+  }
+
+  for (; *p_str; ++p_str)
+  {
+    uint32_t digit;
+
+    if ((*p_str >= '0') && (*p_str <= '9'))
+    {
+      digit = (uint32_t)(*p_str - '0');
+    }
+    else if ((base == 16) && (*p_str >= 'a') && (*p_str <= 'f'))
+    {
+      digit = (uint32_t)(*p_str - 'a' + 10);
+    }
+    else if ((base == 16) && (*p_str >= 'A') && (*p_str <= 'F'))
+    {
+      digit = (uint32_t)(*p_str - 'A' + 10);
+    }
+    else
+    {
+      return false;
+    }
+
+    if (value > ((UINT32_MAX - digit) / base))
+    {
+      return false;
+    }
+    value = (value * base) + digit;
+  }
+
+  (*p_value) = value;
+  return true;
+}
@@ -0,0 +1,137 @@
+/** ========================================================================= *
+ *
+ * @brief Line-assembling command interpreter.
+ *
+ * Bytes are fed in arbitrary chunks (e.g. as they arrive in USB packets), a
+ * command is executed once its line is complete. Lines are terminated by
+ * '\r', '\n' or ';', so one host write may carry a whole list of commands and
+ * a command may be split over several writes. Each line is split into
+ * space/comma separated arguments, the first one selects the handler.
+ *
+ * The module has no platform dependencies, handlers are supplied by the
+ * application.
+ *
+ *  ========================================================================= */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Macros =================================================================== */
+#define COMMAND_LINE_MAX_LENGTH (64) /**< Longest line, incl. terminator. */
+#define COMMAND_MAX_ARGS        (20) /**< Most arguments of one line. */
+
+/* Enums ==================================================================== */
+typedef enum {
+	COMMAND_OK = 0,
+	COMMAND_E_UNKNOWN, /**< No handler matches the command name. */
+	COMMAND_E_ARG,     /**< Wrong amount or value of arguments. */
+	COMMAND_E_LENGTH,  /**< Line was longer than COMMAND_LINE_MAX_LENGTH. */
+	COMMAND_E_FAIL     /**< Handler could not apply the command. */
+} command_status_t;
+
+/* Types ==================================================================== */
+
+/**
+ * @brief Command handler.
+ *
+ * @param[in]  argc  Amount of arguments, argv[0] is the command name.
+ * @param[in]  argv  NUL-terminated arguments.
+ *
+ * @return  Result reported back to the host.
+ */
+typedef command_status_t (*command_handler_t)(uint8_t argc, char * argv[]);
+
+/**
+ * @brief Command table entry.
+ */
+typedef struct
+{
+  const char *      name;    /**< Command name, matched exactly. */
+  command_handler_t handler; /**< Handler to call. */
+} command_entry_t;
+
+/**
+ * @brief Result callback, called once per executed line.
+ *
+ * @param[in]  p_name  Command name (or the raw line if it had none).
+ * @param[in]  status  Result of the command.
+ */
+typedef void (*command_result_t)(const char * p_name, command_status_t status);
+
+/**
+ * @brief Interpreter state.
+ */
+typedef struct
+{
+  const command_entry_t * p_table;      /**< Command table. */
+  size_t                  table_size;   /**< Entries in p_table. */
+  command_handler_t       fallback;     /**< Called for unknown names. */
+  command_result_t        result;       /**< Optional result callback. */
+  char    line[COMMAND_LINE_MAX_LENGTH]; /**< Line being assembled. */
+  size_t  length;                        /**< Bytes in line. */
+  bool    overflow;                      /**< Current line is too long. */
+} command_ctx_t;
+
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+
+/**
+ * @brief Initializes the interpreter.
+ *
+ * @param[out] p_ctx      Interpreter state.
+ * @param[in]  p_table    Command table.
+ * @param[in]  table_size Entries in p_table.
+ * @param[in]  fallback   Handler for lines with unknown names, may be NULL.
+ * @param[in]  result     Result callback, may be NULL.
+ */
+void command_init(command_ctx_t *         p_ctx,
+                  const command_entry_t * p_table,
+                  size_t                  table_size,
+                  command_handler_t       fallback,
+                  command_result_t        result);
+
+/**
+ * @brief Feeds received bytes, executes every line completed by them.
+ *
+ * @param[in]  p_ctx   Interpreter state.
+ * @param[in]  p_data  Received bytes.
+ * @param[in]  length  Amount of bytes.
+ */
+void command_feed(command_ctx_t * p_ctx, const uint8_t * p_data, size_t length);
+
+/**
+ * @brief Executes a single line, without assembling.
+ *
+ * Lines with more than COMMAND_MAX_ARGS arguments are rejected with
+ * COMMAND_E_ARG, the handler is not called.
+ *
+ * @param[in]  p_ctx   Interpreter state.
+ * @param[in]  p_line  NUL-terminated line, modified in place.
+ *
+ * @return  Result of the command.
+ */
+command_status_t command_execute(command_ctx_t * p_ctx, char * p_line);
+
+/**
+ * @brief Parses unsigned number, decimal or hex with "0x" prefix.
+ *
+ * @param[in]  p_str    NUL-terminated string.
+ * @param[out] p_value  Parsed value.
+ *
+ * @return  true if the whole string is a valid number.
+ */
+bool command_parse_uint(const char * p_str, uint32_t * p_value);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,314 @@
+/** ========================================================================= *
+ *
+ * @brief Host unit test of the command interpreter.
+ *
+ * Feeds command lines in various chunkings and checks which handlers ran,
+ * with which arguments, and which results were reported.
+ *
+ * Usage: test_command [seed]
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "command.h"
+
+/* Defines ================================================================== */
+#define LOG_SIZE      (1024)
+#define RANDOM_SPLITS (10000)
+
+/* Macros =================================================================== */
+#define CHECK(__cond)                                                         \
+  do                                                                          \
+  {                                                                           \
+    if (!(__cond))                                                            \
+    {                                                                         \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #__cond);       \
+      failures++;                                                             \
+    }                                                                         \
+  } while (0)
+
+/* Variables ================================================================ */
+static unsigned int  failures;
+static uint32_t      random_state = 1;
+static command_ctx_t ctx;
+
+/* Handler calls and results, as text, e.g. "echo(a,b) echo=0 ". */
+static char   log_text[LOG_SIZE];
+static size_t log_length;
+
+/* Private functions  ======================================================= */
+
+static uint32_t random_next(void)
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+static void log_append(const char * p_text)
+{
+  log_length += (size_t)snprintf(&log_text[log_length], sizeof(log_text) - log_length, "%s",
+                                 p_text);
+}
+
+static void log_clear(void)
+{
+  log_text[0] = '\0';
+  log_length  = 0;
+}
+
+static command_status_t handler_log(const char * p_name, uint8_t argc, char * argv[])
+{
+  log_append(p_name);
+  log_append("(");
+  for (uint8_t i = 1; i < argc; ++i)
+  {
+    log_append((i > 1) ? "," : "");
+    log_append(argv[i]);
+  }
+  log_append(") ");
+
+  return COMMAND_OK;
+}
+
+static command_status_t handler_echo(uint8_t argc, char * argv[])
+{
+  return handler_log("echo", argc, argv);
+}
+
+static command_status_t handler_fail(uint8_t argc, char * argv[])
+{
+  handler_log("fail", argc, argv);
+  return COMMAND_E_FAIL;
+}
+
+static void result_log(const char * p_name, command_status_t status)
+{
+  char text[32];
+
+  snprintf(text, sizeof(text), "%.16s=%d ", p_name, (int)status);
+  log_append(text);
+}
+
+static const command_entry_t table[] = {
+  { "echo", handler_echo },
+  { "fail", handler_fail },
+};
+
+static void feed(const char * p_text)
+{
+  command_feed(&ctx, (const uint8_t *)p_text, strlen(p_text));
+}
+
+static void check_log(const char * p_expected)
+{
+  if (strcmp(log_text, p_expected) != 0)
+  {
+    printf("expected: %s\nlogged:   %s\n", p_expected, log_text);
+    failures++;
+  }
+  log_clear();
+}
+
+static void test_lines(void)
+{
+  command_init(&ctx, table, 2, NULL, result_log);
+
+  /* One command, terminators of every kind. */
+  feed("echo a b\r");
+  check_log("echo(a,b) echo=0 ");
+  feed("echo\n");
+  check_log("echo() echo=0 ");
+  feed("fail x;");
+  check_log("fail(x) fail=4 ");
+
+  /* Several commands in one packet, empty lines are ignored. */
+  feed("echo 1;echo 2,3\r\n\r\n;;fail\techo 4\nbogus 5;");
+  check_log("echo(1) echo=0 echo(2,3) echo=0 fail(echo,4) fail=4 bogus=1 ");
+
+  /* Separators around and between arguments. */
+  feed("  echo ,, a , b  \r");
+  check_log("echo(a,b) echo=0 ");
+
+  /* Nothing runs until the line is terminated. */
+  feed("echo abc");
+  check_log("");
+  feed(";");
+  check_log("echo(abc) echo=0 ");
+}
+
+static void test_split_packets(void)
+{
+  static const char stream[] = "echo 0x10 20;fail a\r\necho\rbogus;echo x,y,z\n";
+  static const char expected[] =
+    "echo(0x10,20) echo=0 fail(a) fail=4 echo() echo=0 bogus=1 echo(x,y,z) echo=0 ";
+
+  command_init(&ctx, table, 2, NULL, result_log);
+
+  /* Every chunking of the stream gives the same result. */
+  for (uint32_t n = 0; n < RANDOM_SPLITS; ++n)
+  {
+    size_t pos = 0;
+
+    while (pos < (sizeof(stream) - 1))
+    {
+      size_t chunk = 1 + (random_next() % 8);
+
+      if (chunk > (sizeof(stream) - 1 - pos))
+      {
+        chunk = sizeof(stream) - 1 - pos;
+      }
+      command_feed(&ctx, (const uint8_t *)&stream[pos], chunk);
+      pos += chunk;
+    }
+
+    if (strcmp(log_text, expected) != 0)
+    {
+      check_log(expected);
+      break;
+    }
+    log_clear();
+  }
+}
+
+static void test_length(void)
+{
+  char line[COMMAND_LINE_MAX_LENGTH + 8];
+
+  command_init(&ctx, table, 2, NULL, result_log);
+
+  /* Longest line that fits, terminator excluded. */
+  memset(line, 'a', sizeof(line));
+  memcpy(line, "echo ", 5);
+  line[COMMAND_LINE_MAX_LENGTH - 1] = '\0';
+  feed(line);
+  feed("\r");
+  CHECK(strncmp(log_text, "echo(aaa", 8) == 0);
+  CHECK(strstr(log_text, ") echo=0 ") != NULL);
+  log_clear();
+
+  /* One byte more is rejected as a whole, split over two packets. */
+  line[COMMAND_LINE_MAX_LENGTH - 1] = 'a';
+  line[COMMAND_LINE_MAX_LENGTH]     = '\0';
+  feed(line);
+  feed("bbbbbbbbbb");
+  check_log("");
+  feed("\necho ok\n");
+  check_log("=3 echo(ok) echo=0 ");
+}
+
+static void test_args(void)
+{
+  char   line[128];
+  size_t pos = (size_t)sprintf(line, "echo");
+
+  command_init(&ctx, table, 2, NULL, result_log);
+
+  /* Name and COMMAND_MAX_ARGS - 1 arguments still run. */
+  for (uint8_t i = 1; i < COMMAND_MAX_ARGS; ++i)
+  {
+    pos += (size_t)sprintf(&line[pos], " %X", i);
+  }
+  CHECK(command_execute(&ctx, line) == COMMAND_OK);
+  check_log("echo(1,2,3,4,5,6,7,8,9,A,B,C,D,E,F,10,11,12,13) echo=0 ");
+
+  /* One more is rejected, the handler does not run. */
+  strcpy(line, "echo 1 2 3 4 5 6 7 8 9 A B C D E F 10 11 12 13 14");
+  CHECK(command_execute(&ctx, line) == COMMAND_E_ARG);
+  check_log("echo=2 ");
+
+  /* Trailing separators do not count as arguments. */
+  strcpy(line, "echo 1 2 3 4 5 6 7 8 9 A B C D E F 10 11 12 13 , ");
+  CHECK(command_execute(&ctx, line) == COMMAND_OK);
+  check_log("echo(1,2,3,4,5,6,7,8,9,A,B,C,D,E,F,10,11,12,13) echo=0 ");
+
+  /* Unknown names go to the fallback. */
+  command_init(&ctx, table, 2, handler_echo, result_log);
+  strcpy(line, "other 1");
+  CHECK(command_execute(&ctx, line) == COMMAND_OK);
+  check_log("echo(1) other=0 ");
+}
+
+static void test_parse_uint(void)
+{
+  static const struct
+  {
+    const char * p_str;
+    bool         valid;
+    uint32_t     value;
+  } cases[] = {
+    { "0", true, 0 },
+    { "42", true, 42 },
+    { "007", true, 7 },
+    { "4294967295", true, UINT32_MAX },
+    { "4294967296", false, 0 },
+    { "42949672950", false, 0 },
+    { "99999999999999999999", false, 0 },
+    { "0x0", true, 0 },
+    { "0x7FF", true, 0x7FF },
+    { "0X1fffffff", true, 0x1FFFFFFF },
+    { "0xFFFFFFFF", true, UINT32_MAX },
+    { "0x100000000", false, 0 },
+    { "0x000000001", true, 1 },
+    { "", false, 0 },
+    { "0x", false, 0 },
+    { "-1", false, 0 },
+    { "+1", false, 0 },
+    { "12a", false, 0 },
+    { "0xG", false, 0 },
+    { "0x 1", false, 0 },
+    { "1 ", false, 0 },
+    { "ABC", false, 0 },
+  };
+
+  for (size_t i = 0; i < (sizeof(cases) / sizeof(cases[0])); ++i)
+  {
+    uint32_t value = 0xA5A5A5A5;
+    bool     valid = command_parse_uint(cases[i].p_str, &value);
+
+    if ((valid != cases[i].valid) || (valid && (value != cases[i].value)) ||
+        (!valid && (value != 0xA5A5A5A5)))
+    {
+      printf("parse \"%s\": valid=%d value=%lu\n", cases[i].p_str, valid, (unsigned long)value);
+      failures++;
+    }
+  }
+
+  /* Random values round trip in both bases. */
+  for (uint32_t n = 0; n < RANDOM_SPLITS; ++n)
+  {
+    uint32_t expected = random_next() >> (random_next() % 32);
+    uint32_t value    = 0;
+    char     text[16];
+
+    snprintf(text, sizeof(text), "%lu", (unsigned long)expected);
+    CHECK(command_parse_uint(text, &value) && (value == expected));
+    snprintf(text, sizeof(text), "0x%lx", (unsigned long)expected);
+    CHECK(command_parse_uint(text, &value) && (value == expected));
+  }
+}
+
+/* Shared functions ========================================================= */
+int main(int argc, char * argv[])
+{
+  if (argc > 1)
+  {
+    random_state = (uint32_t)strtoul(argv[1], NULL, 0);
+    random_state = random_state ? random_state : 1;
+  }
+  printf("seed %lu\n", (unsigned long)random_state);
+
+  test_lines();
+  test_split_packets();
+  test_length();
+  test_args();
+  test_parse_uint();
+
+  printf("%s, %u failures\n", failures ? "FAILED" : "PASSED", failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,25 +1,89 @@
 #include "console.h"
 #include <stdarg.h>
 #include <stdio.h>
-#include <stdlib.h>
+#include <string.h>
 
 /* Platform includes */
 #include "main.h"
 #include "usbd_cdc_if.h"
 #include "fast_fifo.h"
+#include "stream.h"
+#include "command.h"
+#include "can_stats.h"
+#include "can.h"
+#include "replay.h"
+#include "capture.h"
 
-fast_fifo_t my_fifo;
-uint8_t my_fifo_buffer[2048];
+/* One IN transfer may span the whole CDC buffer, USB core splits it into packets */
+#define CONSOLE_TX_MAX_LENGTH		(APP_TX_DATA_SIZE)
+#define CONSOLE_RATE_PERIOD			(1000)
 
-extern uint32_t pid_to_request;
+FAST_FIFO_DEFINE(console_fifo, 2048);
+
+/* Raw bytes received from host, USB ISR is the only producer. Holds a few
+ * packets, so trace upload keeps flowing while main loop is busy */
+FAST_FIFO_DEFINE(console_rx_fifo, 512);
+
+/* OUT endpoint left NAKing because another packet would not fit */
+static volatile bool rx_paused;
+
+static command_ctx_t console_command;
+
+/* Bytes of the transfer owned by USB, released on its completion */
+static volatile size_t tx_in_flight;
+static volatile uint32_t tx_total;
+static uint32_t tx_rate;
+
+static command_status_t console_cmd_pid(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_rate(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_filter(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_format(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_bitrate(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_autobaud(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_listen(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_txq(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_delta(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_snapshot(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_replay(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_trigger(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_capture(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_stats(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_ids(uint8_t argc, char *argv[]);
+static command_status_t console_cmd_request(uint8_t argc, char *argv[]);
+static void console_cmd_result(const char *name, command_status_t status);
+
+static const command_entry_t console_commands[] = {
+	{ "pid", console_cmd_pid },			/* pid [<pid> ...]: PIDs polled in round robin, none stops polling */
+	{ "rate", console_cmd_rate },		/* rate <ms>: period between two PID requests */
+	{ "filter", console_cmd_filter },	/* filter [hs|ms] all | <id>[-<last>] ...: hardware RX filter, all splits bus over both FIFOs */
+	{ "format", console_cmd_format },	/* format bin|txt: output stream format */
+	{ "bitrate", console_cmd_bitrate },	/* bitrate [hs|ms] 125|250|500|1000: CAN bitrate in kbit/s */
+	{ "autobaud", console_cmd_autobaud },	/* autobaud: detect and apply bitrate of every bus, blocks up to 1.2 s */
+	{ "listen", console_cmd_listen },	/* listen on|off: silent mode, no ACK/error frames, OBD requests blocked */
+	{ "txq", console_cmd_txq },			/* txq [hs|ms]: TX queue depth, drops & wait times */
+	{ "delta", console_cmd_delta },		/* delta off | delta <heartbeat ms>: forward changed payloads only, 0 = no heartbeat */
+	{ "snapshot", console_cmd_snapshot },	/* snapshot: latest payload of every ID, binary records */
+	{ "replay", console_cmd_replay },	/* replay: binary trace records follow the OK until their end record */
+	{ "trigger", console_cmd_trigger },	/* trigger off | [hs|ms|mm] error | [hs|ms|mm] <id>[/<mask>] [<hex payload, x = any nibble>]: add capture trigger */
+	{ "capture", console_cmd_capture },	/* capture [arm <pre> <post> | stop | off | dump]: pre/post-trigger window, dumped as binary records once frozen */
+	{ "stats", console_cmd_stats },		/* stats: USB throughput & RX fifo counters */
+	{ "ids", console_cmd_ids },			/* ids [reset]: per-ID statistics table, binary records */
+};
 
 void console_init(void){
-	fast_fifo_init(&my_fifo, my_fifo_buffer, sizeof(my_fifo_buffer)/sizeof(my_fifo_buffer[0]));
+	/* Buffer & mask are set up at compile time, just drop stale data */
+	fast_fifo_deinit(&console_fifo);
+	fast_fifo_deinit(&console_rx_fifo);
+
+	/* Bare number is a one-shot PID request */
+	command_init(&console_command, console_commands, GET_SIZE(console_commands),
+				 console_cmd_request, console_cmd_result);
 }
 
-void console_print(char *fmt, ...){
+bool console_print(char *fmt, ...){
   char buffer[256];
   size_t length;
+  fifo_error_t error = E_OK;
 
   va_list args;
   va_start(args, fmt);
@@ -27,40 +91,480 @@ void console_print(char *fmt, ...){
   va_end(args);
 
   if(length){
-	__disable_irq();
-	fast_fifo_write(&my_fifo, (uint8_t *)buffer, length);
-	__enable_irq();
+	/* Console has several producers (ISRs & main), each one claims its own
+	 * span of the fifo, so no interrupts are masked here */
+	if(stream_get_format() == STREAM_FORMAT_BINARY){
+		uint8_t record[STREAM_ENCODED_SIZE(sizeof(buffer) + 2)];
+		error = fast_fifo_write_mp(&console_fifo, record, stream_encode_text(record, buffer, length));
+	}
+	else{
+		error = fast_fifo_write_mp(&console_fifo, (uint8_t *)buffer, length);
+	}
   }
+
+  return (error == E_OK);
+}
+
+bool console_write(const void *data, size_t length){
+	return (fast_fifo_write_mp(&console_fifo, (const uint8_t *)data, length) == E_OK);
+}
+
+size_t console_get_free(void){
+	return console_fifo_get_free();
 }
 
-void console_input(uint8_t *buffer, uint32_t length){
-	int value = atoi(buffer);
+/* Called from USB ISR, parsing is deferred to main loop. Returns false when
+ * another packet would not fit, reception then waits for console_main() */
+bool console_input(uint8_t *buffer, uint32_t length){
+	fast_fifo_write(&console_rx_fifo, buffer, length);
+
+	if(console_rx_fifo_get_free() < CDC_DATA_FS_MAX_PACKET_SIZE){
+		rx_paused = true;
+		return false;
+	}
+	return true;
+}
 
-	if(value){
-		if(value > 255){
-			value = 255;
+static command_status_t console_cmd_pid(uint8_t argc, char *argv[]){
+	uint8_t pids[OBD2_PID_LIST_MAX];
+	uint32_t value;
+
+	if(argc - 1 > OBD2_PID_LIST_MAX){
+		return COMMAND_E_ARG;
+	}
+
+	for(uint8_t i = 1; i < argc; i++){
+		if(!command_parse_uint(argv[i], &value) || value == 0 || value > 0xFF){
+			return COMMAND_E_ARG;
 		}
+		pids[i - 1] = (uint8_t)value;
+	}
+
+	obd2_set_pid_list(pids, argc - 1);
+	return COMMAND_OK;
+}
+
+static command_status_t console_cmd_rate(uint8_t argc, char *argv[]){
+	uint32_t value;
 
-		pid_to_request = value;
+	if(argc != 2 || !command_parse_uint(argv[1], &value)){
+		return COMMAND_E_ARG;
 	}
+
+	obd2_set_request_period(value);
+	return COMMAND_OK;
 }
 
-void console_main(void){
-	static uint8_t send_buffer[128];
-	static size_t send_length;
+/* Optional bus argument in front of the others, HS bus if omitted */
+static CAN_HandleTypeDef *console_parse_bus(uint8_t argc, char *argv[], uint8_t *p_first){
+	*p_first = 2;
+
+	if(argc > 1 && strcmp(argv[1], "hs") == 0){
+		return &hcan2;
+	}
+	if(argc > 1 && strcmp(argv[1], "ms") == 0){
+		return &hcan1;
+	}
+
+	*p_first = 1;
+	return &hcan2;
+}
+
+static command_status_t console_cmd_filter(uint8_t argc, char *argv[]){
+	can_filter_rule_t rules[CAN_FILTER_RULES_MAX];
+	can_filter_status_t status;
+	uint8_t first;
+	CAN_HandleTypeDef *p_can = console_parse_bus(argc, argv, &first);
+
+	if(argc == first + 1 && strcmp(argv[first], "all") == 0){
+		status = Can_SetFilterAll(p_can);
+	}
+	else{
+		if(argc <= first || argc - first > CAN_FILTER_RULES_MAX){
+			return COMMAND_E_ARG;
+		}
 
-	send_length = fast_fifo_get_available(&my_fifo);
+		/* <id> or <first>-<last>, IDs above 0x7FF are extended */
+		for(uint8_t i = first; i < argc; i++){
+			can_filter_rule_t *p_rule = &rules[i - first];
+			char *p_last = strchr(argv[i], '-');
 
-	if(send_length && (CDC_Transmit_IsBusy() == USBD_OK)){
-		if(send_length > sizeof(send_buffer)){
-			send_length = sizeof(send_buffer);
+			if(p_last){
+				*p_last++ = '\0';
+			}
+			if(!command_parse_uint(argv[i], &p_rule->first) ||
+					(p_last && !command_parse_uint(p_last, &p_rule->last))){
+				return COMMAND_E_ARG;
+			}
+			if(!p_last){
+				p_rule->last = p_rule->first;
+			}
+			p_rule->ext = (p_rule->last > CAN_FILTER_STD_ID_MAX);
 		}
 
-		/* Extract & send data from fifo */
-		__disable_irq();
-		fast_fifo_read(&my_fifo, send_buffer, &send_length);
-		__enable_irq();
-		CDC_Transmit_FS(send_buffer, (uint16_t)send_length);
+		status = Can_SetFilterRules(p_can, rules, argc - first);
+	}
+
+	if(status == CAN_FILTER_WIDENED){
+		console_print("FILTER WIDENED BANKS=%u\r\n", (unsigned int)Can_GetFilterBankCount(p_can));
+	}
+	else if(status == CAN_FILTER_E_NOSPACE){
+		console_print("FILTER NO SPACE\r\n");
+		return COMMAND_E_FAIL;
+	}
+	else if(status != CAN_FILTER_OK){
+		return COMMAND_E_ARG;
 	}
+	return COMMAND_OK;
 }
 
+static command_status_t console_cmd_format(uint8_t argc, char *argv[]){
+	if(argc != 2){
+		return COMMAND_E_ARG;
+	}
+
+	if(strcmp(argv[1], "bin") == 0){
+		stream_set_format(STREAM_FORMAT_BINARY);
+	}
+	else if(strcmp(argv[1], "txt") == 0){
+		stream_set_format(STREAM_FORMAT_TEXT);
+	}
+	else{
+		return COMMAND_E_ARG;
+	}
+	return COMMAND_OK;
+}
+
+static command_status_t console_cmd_bitrate(uint8_t argc, char *argv[]){
+	uint32_t value;
+	uint8_t first;
+	CAN_HandleTypeDef *p_can = console_parse_bus(argc, argv, &first);
+
+	if(argc != first + 1 || !command_parse_uint(argv[first], &value)){
+		return COMMAND_E_ARG;
+	}
+
+	return (Can_SetBitrate(p_can, value) == HAL_OK) ? COMMAND_OK : COMMAND_E_FAIL;
+}
+
+static command_status_t console_cmd_autobaud(uint8_t argc, char *argv[]){
+	uint32_t kbit[CAN_BUS_COUNT];
+
+	if(argc != 1){
+		return COMMAND_E_ARG;
+	}
+
+	Can_AutoDetect(kbit);
+	console_print("AUTOBAUD HS=%lu MS=%lu MM=%lu\r\n", kbit[CAN_BUS_HS], kbit[CAN_BUS_MS], kbit[CAN_BUS_MM]);
+	return COMMAND_OK;
+}
+
+static command_status_t console_cmd_listen(uint8_t argc, char *argv[]){
+	bool enable;
+
+	if(argc != 2){
+		return COMMAND_E_ARG;
+	}
+
+	if(strcmp(argv[1], "on") == 0){
+		enable = true;
+	}
+	else if(strcmp(argv[1], "off") == 0){
+		enable = false;
+	}
+	else{
+		return COMMAND_E_ARG;
+	}
+
+	return (Can_SetListenOnly(enable) == HAL_OK) ? COMMAND_OK : COMMAND_E_FAIL;
+}
+
+static command_status_t console_cmd_txq(uint8_t argc, char *argv[]){
+	uint8_t first;
+	const tx_queue_t *p_queue = Can_GetTxQueue(console_parse_bus(argc, argv, &first));
+
+	if(argc != first){
+		return COMMAND_E_ARG;
+	}
+
+	console_print("TXQ DEPTH=%u HWM=%u SENT=%lu DROP=%lu WAIT_AVG=%luus WAIT_MAX=%luus\r\n",
+				  (unsigned int)tx_queue_get_depth(p_queue), (unsigned int)p_queue->high_water,
+				  p_queue->sent_count, p_queue->dropped_count,
+				  p_queue->wait_avg >> TX_QUEUE_AVG_SHIFT, p_queue->wait_max);
+	return COMMAND_OK;
+}
+
+static command_status_t console_cmd_delta(uint8_t argc, char *argv[]){
+	uint32_t value;
+
+	if(argc != 2){
+		return COMMAND_E_ARG;
+	}
+
+	if(strcmp(argv[1], "off") == 0){
+		sniffer_set_delta(false, 0);
+	}
+	else if(command_parse_uint(argv[1], &value)){
+		sniffer_set_delta(true, value);
+	}
+	else{
+		return COMMAND_E_ARG;
+	}
+	return COMMAND_OK;
+}
+
+static command_status_t console_cmd_snapshot(uint8_t argc, char *argv[]){
+	if(argc != 1){
+		return COMMAND_E_ARG;
+	}
+
+	sniffer_dump_snapshot();
+	return COMMAND_OK;
+}
+
+static command_status_t console_cmd_replay(uint8_t argc, char *argv[]){
+	if(argc != 1){
+		return COMMAND_E_ARG;
+	}
+
+	return replay_start() ? COMMAND_OK : COMMAND_E_FAIL;
+}
+
+/* Payload pattern of hex digits, x matches any nibble */
+static bool console_parse_pattern(const char *p_str, uint8_t *p_data, uint8_t *p_mask){
+	size_t length = strlen(p_str);
+
+	if(length == 0 || length > 16 || (length & 1)){
+		return false;
+	}
+
+	for(size_t i = 0; i < length; i++){
+		char c = p_str[i];
+		uint8_t shift = (i & 1) ? 0 : 4;
+		uint8_t nibble;
+
+		if(c == 'x' || c == 'X'){
+			continue;
+		}
+		if(c >= '0' && c <= '9'){
+			nibble = (uint8_t)(c - '0');
+		}
+		else if(c >= 'a' && c <= 'f'){
+			nibble = (uint8_t)(c - 'a' + 10);
+		}
+		else if(c >= 'A' && c <= 'F'){
+			nibble = (uint8_t)(c - 'A' + 10);
+		}
+		else{
+			return false;
+		}
+
+		p_data[i / 2] |= (uint8_t)(nibble << shift);
+		p_mask[i / 2] |= (uint8_t)(0x0F << shift);
+	}
+	return true;
+}
+
+static command_status_t console_cmd_trigger(uint8_t argc, char *argv[]){
+	capture_trigger_t trigger = { .id = 0, .id_mask = 0, .type = CAPTURE_TRIGGER_FRAME,
+								  .bus = CAPTURE_BUS_ANY, .ext = false };
+	uint8_t first = 1;
+
+	if(argc == 2 && strcmp(argv[1], "off") == 0){
+		capture_clear_triggers();
+		return COMMAND_OK;
+	}
+
+	if(argc > 1 && strcmp(argv[1], "hs") == 0){
+		trigger.bus = CAN_BUS_HS;
+	}
+	else if(argc > 1 && strcmp(argv[1], "ms") == 0){
+		trigger.bus = CAN_BUS_MS;
+	}
+	else if(argc > 1 && strcmp(argv[1], "mm") == 0){
+		trigger.bus = CAN_BUS_MM;
+	}
+	first += (trigger.bus != CAPTURE_BUS_ANY) ? 1 : 0;
+
+	if(argc == first + 1 && strcmp(argv[first], "error") == 0){
+		trigger.type = CAPTURE_TRIGGER_ERROR;
+	}
+	else{
+		char *p_mask;
+
+		if(argc <= first || argc > first + 2){
+			return COMMAND_E_ARG;
+		}
+
+		/* <id> or <id>/<mask>, IDs above 0x7FF are extended */
+		p_mask = strchr(argv[first], '/');
+		if(p_mask){
+			*p_mask++ = '\0';
+		}
+		if(!command_parse_uint(argv[first], &trigger.id) || trigger.id > CAN_FILTER_EXT_ID_MAX ||
+				(p_mask && !command_parse_uint(p_mask, &trigger.id_mask))){
+			return COMMAND_E_ARG;
+		}
+		trigger.ext = (trigger.id > CAN_FILTER_STD_ID_MAX);
+		if(!p_mask){
+			trigger.id_mask = trigger.ext ? CAN_FILTER_EXT_ID_MAX : CAN_FILTER_STD_ID_MAX;
+		}
+
+		if(argc == first + 2 && !console_parse_pattern(argv[first + 1], trigger.data, trigger.data_mask)){
+			return COMMAND_E_ARG;
+		}
+	}
+
+	return (capture_add_trigger(&trigger) == E_OK) ? COMMAND_OK : COMMAND_E_FAIL;
+}
+
+static command_status_t console_cmd_capture(uint8_t argc, char *argv[]){
+	static const char * const state_names[] = { "IDLE", "ARMED", "TRIGGERED", "FROZEN" };
+	uint32_t pre, post;
+
+	if(argc == 4 && strcmp(argv[1], "arm") == 0){
+		if(!command_parse_uint(argv[2], &pre) || !command_parse_uint(argv[3], &post)){
+			return COMMAND_E_ARG;
+		}
+		return (capture_arm(pre, post) == E_OK) ? COMMAND_OK : COMMAND_E_ARG;
+	}
+	if(argc == 2 && strcmp(argv[1], "stop") == 0){
+		capture_freeze();
+		return COMMAND_OK;
+	}
+	if(argc == 2 && strcmp(argv[1], "off") == 0){
+		capture_disarm();
+		return COMMAND_OK;
+	}
+	if(argc == 2 && strcmp(argv[1], "dump") == 0){
+		return sniffer_dump_capture() ? COMMAND_OK : COMMAND_E_FAIL;
+	}
+	if(argc != 1){
+		return COMMAND_E_ARG;
+	}
+
+	console_print("CAPTURE STATE=%s TRIGGERS=%u SIZE=%u\r\n", state_names[capture_get_state()],
+				  (unsigned int)capture_get_trigger_count(), (unsigned int)CAPTURE_SIZE);
+	return COMMAND_OK;
+}
+
+static command_status_t console_cmd_stats(uint8_t argc, char *argv[]){
+	if(argc != 1){
+		return COMMAND_E_ARG;
+	}
+
+	console_print("STATS USB=%luB/s TOTAL=%lu RX_LOST=%lu RX_HWM=%lu FULL=%lu/%lu OVR=%lu/%lu RX_CYC=%lu LISTEN=%u\r\n",
+				  tx_rate, tx_total, sniffer_get_rx_overflow_count(), (uint32_t)sniffer_get_rx_high_water(),
+				  Can_GetRxFullCount(CAN_RX_FIFO0), Can_GetRxFullCount(CAN_RX_FIFO1),
+				  Can_GetRxOverrunCount(CAN_RX_FIFO0), Can_GetRxOverrunCount(CAN_RX_FIFO1),
+				  Can_GetRxCyclesPerFrame(), (unsigned int)Can_IsListenOnly());
+	return COMMAND_OK;
+}
+
+static command_status_t console_cmd_ids(uint8_t argc, char *argv[]){
+	if(argc == 2 && strcmp(argv[1], "reset") == 0){
+		can_stats_reset();
+		return COMMAND_OK;
+	}
+	if(argc != 1){
+		return COMMAND_E_ARG;
+	}
+
+	sniffer_dump_stats();
+	return COMMAND_OK;
+}
+
+static command_status_t console_cmd_request(uint8_t argc, char *argv[]){
+	uint32_t value;
+
+	if(argc != 1 || !command_parse_uint(argv[0], &value)){
+		return COMMAND_E_UNKNOWN;
+	}
+	if(value == 0 || value > 0xFF){
+		return COMMAND_E_ARG;
+	}
+
+	obd2_request_once((uint8_t)value);
+	return COMMAND_OK;
+}
+
+static void console_cmd_result(const char *name, command_status_t status){
+	if(status == COMMAND_OK){
+		console_print("OK %s\r\n", name);
+	}
+	else{
+		console_print("ERROR=%u %s\r\n", (unsigned int)status, name);
+	}
+}
+
+/* Sends next span straight from fifo memory, caller must keep USB IRQ out */
+static void console_tx_start(void){
+	uint8_t *p_data;
+	size_t length;
+
+	if(fast_fifo_acquire_read(&console_fifo, &p_data, &length) == E_OK){
+		if(length > CONSOLE_TX_MAX_LENGTH){
+			length = CONSOLE_TX_MAX_LENGTH;
+		}
+
+		if(CDC_Transmit_FS(p_data, (uint16_t)length) == USBD_OK){
+			tx_in_flight = length;
+		}
+	}
+}
+
+/* Called from USB ISR, chains the next transfer as soon as the previous one
+ * (including its ZLP) is done, so the main loop period does not limit throughput */
+void console_tx_complete(void){
+	if(tx_in_flight && CDC_Transmit_IsBusy() == USBD_OK){
+		fast_fifo_commit_read(&console_fifo, tx_in_flight);
+		tx_total += tx_in_flight;
+		tx_in_flight = 0;
+
+		console_tx_start();
+	}
+}
+
+void console_main(void){
+	static uint32_t rate_tick, rate_total;
+	uint8_t *p_data;
+	size_t length;
+
+	/* Execute commands received from host, a trace upload bypasses the parser
+	 * and leaves whatever the replay has no room for */
+	if(fast_fifo_acquire_read(&console_rx_fifo, &p_data, &length) == E_OK){
+		if(replay_is_loading()){
+			length = replay_input(p_data, length);
+		}
+		else{
+			command_feed(&console_command, p_data, length);
+		}
+		fast_fifo_commit_read(&console_rx_fifo, length);
+	}
+
+	if(rx_paused && console_rx_fifo_get_free() >= CDC_DATA_FS_MAX_PACKET_SIZE){
+		HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+		rx_paused = false;
+		CDC_Receive_Resume_FS();
+		HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+	}
+
+	/* Pump is idle, kick it off. Mask only USB so the consumer side is never
+	 * entered from both contexts, CAN keeps running */
+	if(tx_in_flight == 0){
+		HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+		if(tx_in_flight == 0 && CDC_Transmit_IsBusy() == USBD_OK){
+			console_tx_start();
+		}
+		HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+	}
+
+	if(HAL_GetTick() - rate_tick >= CONSOLE_RATE_PERIOD){
+		uint32_t total = tx_total;
+		uint32_t elapsed = HAL_GetTick() - rate_tick;
+
+		tx_rate = (uint32_t)(((uint64_t)(total - rate_total) * 1000) / elapsed);
+		rate_total = total;
+		rate_tick += elapsed;
+	}
+}
@@ -1,8 +1,13 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 
 void console_init(void);
 void console_main(void);
-void console_input(uint8_t *buffer, uint32_t length);
-void console_print(char *fmt, ...);
+bool console_input(uint8_t *buffer, uint32_t length);
+void console_tx_complete(void);
+bool console_print(char *fmt, ...);
+bool console_write(const void *data, size_t length);
+size_t console_get_free(void);
@@ -0,0 +1,148 @@
+#include "event_log.h"
+
+/* Platform includes */
+#include "main.h"
+#include "console.h"
+#include "fast_fifo.h"
+#include "stream.h"
+#include "can_errors.h"
+
+/* Longest text line of an event, processing waits until console fits it */
+#define EVENT_LOG_LINE_MAX_LENGTH	(64)
+
+/* Error telemetry summaries, at most one per bus and period */
+#define EVENT_LOG_ERRORS_PERIOD		(1000000UL)
+/* Worst case text line: 10 digit timestamp, BUS-OFF, 3 digit counters and
+ * seven 10 digit error counts, 164 characters */
+#define EVENT_LOG_ERRORS_LINE_MAX_LENGTH	(168)
+
+/* Every push is one span of the fifo, so records never get split */
+typedef struct {
+	uint32_t timestamp;
+	uint16_t id;
+	uint16_t reserved;
+	uint32_t args[STREAM_EVENT_MAX_ARGS];
+} event_record_t;
+
+/* Text rendering of events, the host owns the same table in binary mode.
+ * Each format takes timestamp first, then up to two arguments. */
+static const char * const event_formats[EVENT_ID_COUNT] = {
+	[EVENT_RX_FIFO_FULL]		= "%.8lu RX (FIFO=%lu) Full!\r\n",
+	[EVENT_CAN_ERROR]			= "%.8lu CAN ERROR=0x%.8X\r\n",
+	[EVENT_TX_MAILBOX_COMPLETE]	= "%.8lu TX (MBX=%lu) OK!\r\n",
+	[EVENT_TX_MAILBOX_ABORT]	= "%.8lu TX (MBX=%lu) Abort!\r\n",
+	[EVENT_CAN_SLEEP]			= "%.8lu Sleep Callback!\r\n",
+	[EVENT_CAN_WAKEUP]			= "%.8lu RX Wake-up Callback!\r\n",
+	[EVENT_LOG_OVERFLOW]		= "%.8lu Event log overflow! LOST=%lu\r\n",
+	[EVENT_LISTEN_ONLY]			= "%.8lu Listen only=%lu\r\n",
+	[EVENT_CAN_STATE]			= "%.8lu CAN STATE=0x%.4lX TEC/REC=0x%.4lX\r\n",
+};
+
+/* Records pushed from any context, formatted later in main loop */
+FAST_FIFO_DEFINE(event_fifo, 32 * sizeof(event_record_t));
+
+static volatile uint32_t overflow_count;
+static uint32_t reported_overflow_count;
+static uint32_t errors_report_time;
+
+/* Pushes come from main loop and ISRs, a plain increment would lose counts
+ * exactly while the log overflows. STREX fails whenever another context ran
+ * since LDREX, like the span claim of fast_fifo_write_mp */
+static void event_log_count_overflow(void){
+	uint32_t count;
+
+	do{
+		count = __LDREXW(&overflow_count);
+	}while(__STREXW(count + 1, &overflow_count) != 0);
+}
+
+void event_log_push(event_log_id_t id, uint32_t arg0, uint32_t arg1){
+	event_record_t record;
+
+	record.timestamp = timebase_get_us();
+	record.id = (uint16_t)id;
+	record.reserved = 0;
+	record.args[0] = arg0;
+	record.args[1] = arg1;
+
+	if(fast_fifo_write_mp(&event_fifo, (const uint8_t *)&record, sizeof(record)) != E_OK){
+		event_log_count_overflow();
+	}
+}
+
+static void event_log_emit(const event_record_t *p_record){
+	if(stream_get_format() == STREAM_FORMAT_BINARY){
+		uint8_t encoded[STREAM_EVENT_MAX_LENGTH];
+		console_write(encoded, stream_encode_event(encoded, p_record->id, p_record->timestamp,
+												p_record->args, STREAM_EVENT_MAX_ARGS));
+	}
+	else if(p_record->id < EVENT_ID_COUNT && event_formats[p_record->id]){
+		console_print((char *)event_formats[p_record->id], p_record->timestamp,
+					p_record->args[0], p_record->args[1]);
+	}
+}
+
+/* Sends the summary of every bus with new errors once per period, instead
+ * of one line per error from the ISR */
+static void event_log_report_errors(void){
+	static const char * const state_names[] = { "ACTIVE", "WARNING", "PASSIVE", "BUS-OFF" };
+	uint32_t now = timebase_get_us();
+
+	if((now - errors_report_time) < EVENT_LOG_ERRORS_PERIOD){
+		return;
+	}
+
+	for(uint8_t bus = 0; bus < CAN_BUS_COUNT; bus++){
+		can_errors_bus_t snapshot;
+		const can_errors_bus_t *p_bus = &snapshot;
+
+		if(!can_errors_snapshot(bus, &snapshot) || !p_bus->changed ||
+		   console_get_free() < EVENT_LOG_ERRORS_LINE_MAX_LENGTH){
+			continue;
+		}
+
+		bool queued;
+		if(stream_get_format() == STREAM_FORMAT_BINARY){
+			uint8_t encoded[STREAM_ERRORS_MAX_LENGTH];
+			queued = console_write(encoded, stream_encode_errors(encoded, bus, p_bus));
+		}
+		else{
+			queued = console_print("%.8lu ERRORS BUS=%u %s TEC=%u/%u REC=%u/%u STF=%lu FOR=%lu ACK=%lu BIT1=%lu BIT0=%lu CRC=%lu SUP=%lu\r\n",
+						  now, bus, state_names[p_bus->state & 3], p_bus->tec, p_bus->tec_max, p_bus->rec, p_bus->rec_max,
+						  p_bus->lec_count[CAN_ERRORS_LEC_STUFF], p_bus->lec_count[CAN_ERRORS_LEC_FORM],
+						  p_bus->lec_count[CAN_ERRORS_LEC_ACK], p_bus->lec_count[CAN_ERRORS_LEC_BIT1],
+						  p_bus->lec_count[CAN_ERRORS_LEC_BIT0], p_bus->lec_count[CAN_ERRORS_LEC_CRC],
+						  p_bus->suppressed);
+		}
+
+		/* Another producer may have taken the space, the period is then
+		 * reported next time instead of being lost */
+		if(queued){
+			can_errors_reported(bus, &snapshot);
+		}
+	}
+
+	errors_report_time = now;
+}
+
+void event_log_main(void){
+	event_record_t record;
+	size_t length;
+
+	while(console_get_free() >= EVENT_LOG_LINE_MAX_LENGTH){
+		length = sizeof(record);
+		if(fast_fifo_read(&event_fifo, (uint8_t *)&record, &length) != E_OK){
+			break;
+		}
+
+		event_log_emit(&record);
+	}
+
+	uint32_t lost = overflow_count;
+	if(lost != reported_overflow_count){
+		reported_overflow_count = lost;
+		event_log_push(EVENT_LOG_OVERFLOW, lost, 0);
+	}
+
+	event_log_report_errors();
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Event IDs are part of the binary stream, never renumber them */
+typedef enum {
+	EVENT_RX_FIFO_FULL			= 1,	/* arg0: FIFO number */
+	EVENT_CAN_ERROR				= 2,	/* arg0: HAL error code */
+	EVENT_TX_MAILBOX_COMPLETE	= 3,	/* arg0: mailbox number */
+	EVENT_TX_MAILBOX_ABORT		= 4,	/* arg0: mailbox number */
+	EVENT_CAN_SLEEP				= 5,
+	EVENT_CAN_WAKEUP			= 6,
+	EVENT_LOG_OVERFLOW			= 7,	/* arg0: events lost so far */
+	EVENT_LISTEN_ONLY			= 8,	/* arg0: 1 if listen only mode is active */
+	EVENT_CAN_STATE				= 9,	/* arg0: bus | state << 8, arg1: TEC | REC << 8 */
+	EVENT_ID_COUNT
+} event_log_id_t;
+
+void event_log_main(void);
+void event_log_push(event_log_id_t id, uint32_t arg0, uint32_t arg1);
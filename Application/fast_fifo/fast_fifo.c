@@ -1,5 +1,6 @@
 /* Includes ================================================================= */
 #include "fast_fifo.h"
+#include <string.h>
 
 /* Defines ================================================================== */
 /* Macros =================================================================== */
@@ -10,13 +11,132 @@
 /* Variables ================================================================ */
 /* Private functions  ======================================================= */
 
+#if defined(__arm__)
+/**
+ * @brief Exclusive load (LDREX), starts an atomic read-modify-write sequence.
+ */
+static inline size_t exclusive_load(volatile size_t * p_value)
+{
+  size_t value;
+  __asm volatile("ldrex %0, [%1]" : "=r"(value) : "r"(p_value) : "memory");
+  return value;
+}
+
+/**
+ * @brief Exclusive store (STREX), fails if the sequence was interrupted.
+ *
+ * On Cortex-M every exception entry and return clears the exclusive monitor,
+ * so the store fails whenever another context ran since exclusive_load().
+ */
+static inline bool exclusive_store(volatile size_t * p_value, size_t value)
+{
+  uint32_t failed;
+  __asm volatile("strex %0, %2, [%1]"
+                 : "=&r"(failed)
+                 : "r"(p_value), "r"(value)
+                 : "memory");
+  return (failed == 0);
+}
+
+/**
+ * @brief Abandons the sequence started with exclusive_load() (CLREX).
+ */
+static inline void exclusive_clear(void)
+{
+  __asm volatile("clrex" ::: "memory");
+}
+#else
+/* Host builds are single threaded, plain accesses are enough. */
+static inline size_t exclusive_load(volatile size_t * p_value)
+{
+  return *p_value;
+}
+
+static inline bool exclusive_store(volatile size_t * p_value, size_t value)
+{
+  *p_value = value;
+  return true;
+}
+
+static inline void exclusive_clear(void)
+{
+}
+#endif
+
+/**
+ * @brief Registers a producer which is about to reserve a span.
+ */
+static void ringbuf_producer_enter(fast_fifo_t * p_fifo)
+{
+  size_t pending;
+
+  do
+  {
+    pending = exclusive_load(&p_fifo->pending);
+  } while (!exclusive_store(&p_fifo->pending, pending + 1));
+}
+
+/**
+ * @brief Unregisters a producer and publishes the reserved spans.
+ *
+ * Producers preempt each other in a strictly nested way, so the outermost
+ * producer is always the last one to finish. It is the only one that sees
+ * pending == 1, and every span reserved up to that point is already filled,
+ * so it may publish write_pos up to reserve_pos. If another producer
+ * preempts it in between, the exclusive store fails and the publication is
+ * repeated with the newer reserve_pos.
+ */
+static void ringbuf_producer_leave(fast_fifo_t * p_fifo)
+{
+  size_t pending;
+
+  do
+  {
+    pending = exclusive_load(&p_fifo->pending);
+    if (pending == 1)
+    {
+      FAST_FIFO_MEMORY_BARRIER();
+      p_fifo->write_pos = p_fifo->reserve_pos;
+    }
+  } while (!exclusive_store(&p_fifo->pending, pending - 1));
+}
+
+/**
+ * @brief Atomically claims a span of the ring buffer for a producer.
+ */
+static bool
+ringbuf_reserve(fast_fifo_t * p_fifo, size_t amount, size_t * p_position)
+{
+  size_t r_position;
+
+  do
+  {
+    r_position = exclusive_load(&p_fifo->reserve_pos);
+    if (amount > (p_fifo->buf_size_mask -
+                  (p_fifo->buf_size_mask & (r_position - p_fifo->read_pos))))
+    {
+      exclusive_clear();
+      return false;
+    }
+  } while (!exclusive_store(&p_fifo->reserve_pos, r_position + amount));
+
+  FAST_FIFO_MEMORY_BARRIER();
+  (*p_position) = r_position;
+  return true;
+}
+
 /**
  * @brief Returns the number of bytes available in the ring buffer.
+ *
+ * The barrier keeps the following buffer accesses after the position loads:
+ * the consumer never reads data that is not published yet, and the producer
+ * never overwrites data that is still being copied out.
  */
 static size_t ringbuf_get_used(fast_fifo_t * p_fifo)
 {
   size_t r_position = p_fifo->read_pos;
   size_t w_position = p_fifo->write_pos;
+  FAST_FIFO_MEMORY_BARRIER();
   return (p_fifo->buf_size_mask & (w_position - r_position));
 }
 
@@ -26,6 +146,7 @@ static size_t ringbuf_get_used(fast_fifo_t * p_fifo)
 static void ringbuf_put(fast_fifo_t * p_fifo, uint8_t byte)
 {
   p_fifo->p_buf[(p_fifo->write_pos & p_fifo->buf_size_mask)] = byte;
+  FAST_FIFO_MEMORY_BARRIER();
   p_fifo->write_pos++;
 }
 
@@ -44,9 +165,62 @@ ringbuf_peek(fast_fifo_t * p_fifo, size_t index, uint8_t * p_byte)
 static void ringbuf_get(fast_fifo_t * p_fifo, uint8_t * p_byte)
 {
   ringbuf_peek(p_fifo, 0, p_byte);
+  FAST_FIFO_MEMORY_BARRIER();
   p_fifo->read_pos++;
 }
 
+/**
+ * @brief Copies a block of bytes to the ring buffer at the given position.
+ *
+ * The transfer is split into at most two contiguous segments (up to the end of
+ * the buffer and from its beginning), each one is copied with memcpy.
+ */
+static void ringbuf_copy_in(fast_fifo_t * p_fifo,
+                            size_t        w_position,
+                            const uint8_t * p_src,
+                            size_t        amount)
+{
+  size_t offset = w_position & p_fifo->buf_size_mask;
+  size_t first  = UTIL_MIN(amount, (p_fifo->buf_size_mask + 1) - offset);
+
+  memcpy(&p_fifo->p_buf[offset], p_src, first);
+  memcpy(p_fifo->p_buf, &p_src[first], amount - first);
+}
+
+/**
+ * @brief Copies a block of bytes to the ring buffer.
+ *
+ * The write position is published only once, after the data has landed.
+ */
+static void ringbuf_write(
+      fast_fifo_t * p_fifo, const uint8_t * p_src, size_t amount)
+{
+  size_t w_position = p_fifo->write_pos;
+
+  ringbuf_copy_in(p_fifo, w_position, p_src, amount);
+
+  FAST_FIFO_MEMORY_BARRIER();
+  p_fifo->write_pos = w_position + amount;
+}
+
+/**
+ * @brief Copies a block of bytes from the ring buffer and then removes it.
+ *
+ * Counterpart of ringbuf_write(), the read position is published only once.
+ */
+static void ringbuf_read(fast_fifo_t * p_fifo, uint8_t * p_dst, size_t amount)
+{
+  size_t r_position = p_fifo->read_pos;
+  size_t offset     = r_position & p_fifo->buf_size_mask;
+  size_t first      = UTIL_MIN(amount, (p_fifo->buf_size_mask + 1) - offset);
+
+  memcpy(p_dst, &p_fifo->p_buf[offset], first);
+  memcpy(&p_dst[first], p_fifo->p_buf, amount - first);
+
+  FAST_FIFO_MEMORY_BARRIER();
+  p_fifo->read_pos = r_position + amount;
+}
+
 /* Shared functions ========================================================= */
 size_t fast_fifo_get_available(fast_fifo_t * p_fifo)
 {
@@ -64,23 +238,41 @@ size_t fast_fifo_get_free(fast_fifo_t * p_fifo)
 
 fifo_error_t fast_fifo_deinit(fast_fifo_t * p_fifo)
 {
+  if (p_fifo == NULL)
+  {
+    return E_NULL;
+  }
+
   /* Deinitialize the critical section. */
-  p_fifo->read_pos  = 0;
-  p_fifo->write_pos = 0;
+  p_fifo->read_pos    = 0;
+  p_fifo->write_pos   = 0;
+  p_fifo->reserve_pos = 0;
+  p_fifo->pending     = 0;
   return E_OK;
 }
 
 fifo_error_t
 fast_fifo_init(fast_fifo_t * p_fifo, uint8_t * p_buf, size_t buf_size)
 {
+  if ((p_fifo == NULL) || (p_buf == NULL))
+  {
+    return E_NULL;
+  }
 
   /* Buffer size must be a power of two since we use the fast mask method for
    * calculating the indexes in circular buffer.
    */
+  if (!FAST_FIFO_IS_POWER_OF_TWO(buf_size))
+  {
+    return E_INVAL;
+  }
+
   p_fifo->p_buf         = p_buf;
   p_fifo->buf_size_mask = buf_size - 1;
   p_fifo->read_pos      = 0;
   p_fifo->write_pos     = 0;
+  p_fifo->reserve_pos   = 0;
+  p_fifo->pending       = 0;
 
   return E_OK;
 }
@@ -157,10 +349,7 @@ fast_fifo_read(fast_fifo_t * p_fifo, uint8_t * const p_dst, size_t * p_size)
       if (p_dst)
       {
         /* Copy the data to the buffer. */
-        for (size_t i = 0; i < must_copy; ++i)
-        {
-          ringbuf_get(p_fifo, &p_dst[i]);
-        }
+        ringbuf_read(p_fifo, p_dst, must_copy);
       }
       else
       {
@@ -185,12 +374,97 @@ fifo_error_t fast_fifo_write(
     if (amount <= available)
     {
       /* Copy data to the FIFO. */
-      for (size_t i = 0; i < amount; ++i)
-      {
-        ringbuf_put(p_fifo, p_src[i]);
-      }
+      ringbuf_write(p_fifo, p_src, amount);
       ret = E_OK;
     }
 
   return ret;
 }
+
+fifo_error_t fast_fifo_write_mp(
+      fast_fifo_t * p_fifo, const uint8_t * const p_src, size_t amount)
+{
+  fifo_error_t ret = E_NOMEM;
+  size_t       w_position;
+
+  ringbuf_producer_enter(p_fifo);
+
+  if (ringbuf_reserve(p_fifo, amount, &w_position))
+  {
+    /* The span is owned by this producer, fill it with interrupts enabled. */
+    ringbuf_copy_in(p_fifo, w_position, p_src, amount);
+    ret = E_OK;
+  }
+
+  ringbuf_producer_leave(p_fifo);
+
+  return ret;
+}
+
+fifo_error_t fast_fifo_acquire_read(
+      fast_fifo_t * p_fifo, uint8_t ** pp_data, size_t * p_size)
+{
+  fifo_error_t ret = E_EMPTY;
+
+  size_t used   = ringbuf_get_used(p_fifo);
+  size_t offset = p_fifo->read_pos & p_fifo->buf_size_mask;
+
+  /* Only the part up to the end of the buffer is contiguous. */
+  (*pp_data) = &p_fifo->p_buf[offset];
+  (*p_size)  = UTIL_MIN(used, (p_fifo->buf_size_mask + 1) - offset);
+
+  if ((*p_size) > 0)
+  {
+    ret = E_OK;
+  }
+
+  return ret;
+}
+
+fifo_error_t fast_fifo_commit_read(fast_fifo_t * p_fifo, size_t size)
+{
+  fifo_error_t ret = E_EMPTY;
+
+  if (size <= ringbuf_get_used(p_fifo))
+  {
+    FAST_FIFO_MEMORY_BARRIER();
+    p_fifo->read_pos += size;
+    ret = E_OK;
+  }
+
+  return ret;
+}
+
+fifo_error_t fast_fifo_acquire_write(
+      fast_fifo_t * p_fifo, uint8_t ** pp_data, size_t * p_size)
+{
+  fifo_error_t ret = E_NOMEM;
+
+  size_t available = p_fifo->buf_size_mask - ringbuf_get_used(p_fifo);
+  size_t offset    = p_fifo->write_pos & p_fifo->buf_size_mask;
+
+  /* Only the part up to the end of the buffer is contiguous. */
+  (*pp_data) = &p_fifo->p_buf[offset];
+  (*p_size)  = UTIL_MIN(available, (p_fifo->buf_size_mask + 1) - offset);
+
+  if ((*p_size) > 0)
+  {
+    ret = E_OK;
+  }
+
+  return ret;
+}
+
+fifo_error_t fast_fifo_commit_write(fast_fifo_t * p_fifo, size_t size)
+{
+  fifo_error_t ret = E_NOMEM;
+
+  if (size <= (p_fifo->buf_size_mask - ringbuf_get_used(p_fifo)))
+  {
+    FAST_FIFO_MEMORY_BARRIER();
+    p_fifo->write_pos += size;
+    ret = E_OK;
+  }
+
+  return ret;
+}
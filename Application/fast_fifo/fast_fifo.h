@@ -16,11 +16,67 @@ extern "C" {
 #include <stddef.h>
 
 /* Macros =================================================================== */
+
+/**
+ * @brief Orders buffer accesses against the read/write position updates, so
+ *        that one producer and one consumer may run in different contexts
+ *        without locking.
+ */
+#if defined(__arm__)
+#define FAST_FIFO_MEMORY_BARRIER() __asm volatile("dmb" ::: "memory")
+#else
+#define FAST_FIFO_MEMORY_BARRIER() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/**
+ * @brief Evaluates to true if the value is a non-zero power of two.
+ */
+#define FAST_FIFO_IS_POWER_OF_TWO(__n) (((__n) != 0) && (((__n) & ((__n) - 1)) == 0))
+
+/**
+ * @brief Defines a FIFO instance with compile-time size.
+ *
+ * The size is checked to be a power of two at compile time, the instance is
+ * statically initialized (no fast_fifo_init() call is needed), and the
+ * following helpers with the mask baked in as a constant are generated:
+ *   <name>_get_available(), <name>_get_free(), <name>_put(), <name>_get().
+ * The instance is a regular fast_fifo_t, so all fast_fifo_*() functions may be
+ * used on it as well.
+ *
+ * @param __name  Name of the fast_fifo_t instance.
+ * @param __size  Buffer size in bytes, must be a power of two.
+ */
+#define FAST_FIFO_DEFINE(__name, __size)                                      \
+  _Static_assert(FAST_FIFO_IS_POWER_OF_TWO(__size),                           \
+                 #__name " size must be a power of two");                     \
+  static uint8_t     __name##_buffer[(__size)];                               \
+  static fast_fifo_t __name = {                                               \
+    .p_buf = __name##_buffer, .buf_size_mask = (__size) - 1                   \
+  };                                                                          \
+  static inline size_t __name##_get_available(void)                           \
+  {                                                                           \
+    return fast_fifo_const_get_used(&__name, (__size) - 1);                   \
+  }                                                                           \
+  static inline size_t __name##_get_free(void)                                \
+  {                                                                           \
+    return ((__size) - 1) - fast_fifo_const_get_used(&__name, (__size) - 1);  \
+  }                                                                           \
+  static inline fifo_error_t __name##_put(uint8_t byte)                       \
+  {                                                                           \
+    return fast_fifo_const_put(&__name, (__size) - 1, byte);                  \
+  }                                                                           \
+  static inline fifo_error_t __name##_get(uint8_t * p_byte)                   \
+  {                                                                           \
+    return fast_fifo_const_get(&__name, (__size) - 1, p_byte);                \
+  }
+
 /* Enums ==================================================================== */
 typedef enum {
 	E_OK = 0,
 	E_EMPTY,
-	E_NOMEM
+	E_NOMEM,
+	E_NULL,
+	E_INVAL
 } fifo_error_t;
 
 /* Types ==================================================================== */
@@ -31,6 +87,13 @@ typedef enum {
  * This structure utilizes Fast FIFO circular buffer, which means that data that
  * is written to the buffer will wrap around to the beginning of the buffer
  * once the end of the buffer is reached.
+ *
+ * A single producer and a single consumer may use the FIFO concurrently (e.g.
+ * an interrupt and the main loop) without a critical section: the producer
+ * publishes write_pos only after the data has landed in the buffer, and the
+ * consumer publishes read_pos only after the data has been copied out. Several
+ * producers (or consumers) must still be serialized by the caller, unless all
+ * the producers use fast_fifo_write_mp().
  */
 typedef struct
 {
@@ -38,6 +101,8 @@ typedef struct
   volatile size_t read_pos;      /**< The read position in the buffer. */
   volatile size_t write_pos;     /**< The write position in the buffer. */
   size_t          buf_size_mask; /**< Mask used to calculate the buffer size. */
+  volatile size_t reserve_pos;   /**< End of the spans claimed by producers. */
+  volatile size_t pending;       /**< Producers with a span not yet filled. */
 } fast_fifo_t;
 
 /* Variables ================================================================ */
@@ -184,6 +249,162 @@ fast_fifo_read(fast_fifo_t * p_fifo, uint8_t * const p_dst, size_t * p_size);
 fifo_error_t fast_fifo_write(
       fast_fifo_t * p_fifo, const uint8_t * const p_src, size_t amount);
 
+/**
+ * @brief Writes requested amount of bytes to the FIFO from one of several
+ *        producers, without masking interrupts.
+ *
+ * The producer atomically claims a span of the buffer (LDREX/STREX), fills it
+ * and marks it committed. The consumer sees the span only when every span
+ * claimed before it is filled too, so lines from producers that preempt each
+ * other (e.g. nested interrupts) never interleave.
+ *
+ * @note All the producers of a FIFO must use this function, it may not be
+ *       mixed with fast_fifo_write(), fast_fifo_put() or
+ *       fast_fifo_acquire_write().
+ *
+ * @param[in]  p_fifo Pointer to the FIFO.
+ * @param[out] p_src  Source pointer to copy the bytes to the FIFO.
+ * @param[in] amount  The number of bytes to copy.
+ *
+ * @retval E_OK    The bytes are copied to the FIFO.
+ * @retval E_NOMEM No available space in the FIFO.
+ */
+fifo_error_t fast_fifo_write_mp(
+      fast_fifo_t * p_fifo, const uint8_t * const p_src, size_t amount);
+
+/**
+ * @brief Exposes the largest contiguous readable region of the FIFO in place.
+ *
+ * The data stays in the FIFO until fast_fifo_commit_read() is called, so it
+ * may be handed directly to a peripheral (e.g. USB IN transfer) without an
+ * intermediate copy. If the data wraps around the end of the buffer, only
+ * the first segment is exposed, the rest is returned by the next call.
+ *
+ * @note Function may assert if any of the parameters are NULL.
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[out] pp_data  Pointer to the first readable byte.
+ * @param[out] p_size   Number of contiguous bytes readable from pp_data.
+ *
+ * @retval E_OK    Region is returned.
+ * @retval E_EMPTY If the FIFO is empty.
+ */
+fifo_error_t fast_fifo_acquire_read(
+      fast_fifo_t * p_fifo, uint8_t ** pp_data, size_t * p_size);
+
+/**
+ * @brief Removes bytes previously exposed by fast_fifo_acquire_read().
+ *
+ * @param[in]  p_fifo Pointer to the FIFO.
+ * @param[in]  size   The number of bytes consumed, must not exceed the size
+ *                    of the acquired region.
+ *
+ * @retval E_OK    The bytes are removed from the FIFO.
+ * @retval E_EMPTY The FIFO holds less than size bytes.
+ */
+fifo_error_t fast_fifo_commit_read(fast_fifo_t * p_fifo, size_t size);
+
+/**
+ * @brief Exposes the largest contiguous writable region of the FIFO in place.
+ *
+ * The data written to the region becomes visible to the consumer only after
+ * fast_fifo_commit_write() is called.
+ *
+ * @note Function may assert if any of the parameters are NULL.
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[out] pp_data  Pointer to the first writable byte.
+ * @param[out] p_size   Number of contiguous bytes writable from pp_data.
+ *
+ * @retval E_OK    Region is returned.
+ * @retval E_NOMEM No available space in the FIFO.
+ */
+fifo_error_t fast_fifo_acquire_write(
+      fast_fifo_t * p_fifo, uint8_t ** pp_data, size_t * p_size);
+
+/**
+ * @brief Publishes bytes written to the region from fast_fifo_acquire_write().
+ *
+ * @param[in]  p_fifo Pointer to the FIFO.
+ * @param[in]  size   The number of bytes written, must not exceed the size
+ *                    of the acquired region.
+ *
+ * @retval E_OK    The bytes are added to the FIFO.
+ * @retval E_NOMEM The FIFO has less than size bytes of free space.
+ */
+fifo_error_t fast_fifo_commit_write(fast_fifo_t * p_fifo, size_t size);
+
+/* Inline functions ========================================================= */
+
+/**
+ * @brief Inline variant of fast_fifo_get_available() for FAST_FIFO_DEFINE().
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[in]  mask     Buffer size minus one, expected to be a constant.
+ *
+ * @return  Number of bytes available in the FIFO.
+ */
+static inline size_t
+fast_fifo_const_get_used(const fast_fifo_t * p_fifo, size_t mask)
+{
+  size_t r_position = p_fifo->read_pos;
+  size_t w_position = p_fifo->write_pos;
+  FAST_FIFO_MEMORY_BARRIER();
+  return (mask & (w_position - r_position));
+}
+
+/**
+ * @brief Inline variant of fast_fifo_put() for FAST_FIFO_DEFINE().
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[in]  mask     Buffer size minus one, expected to be a constant.
+ * @param[in]  byte     Byte to add to the FIFO.
+ *
+ * @retval E_OK     If the byte has been successfully added to the FIFO.
+ * @retval E_NOMEM  If the FIFO is full.
+ */
+static inline fifo_error_t
+fast_fifo_const_put(fast_fifo_t * p_fifo, size_t mask, uint8_t byte)
+{
+  if (fast_fifo_const_get_used(p_fifo, mask) >= mask)
+  {
+    return E_NOMEM;
+  }
+
+  p_fifo->p_buf[p_fifo->write_pos & mask] = byte;
+  FAST_FIFO_MEMORY_BARRIER();
+  p_fifo->write_pos++;
+  return E_OK;
+}
+
+/**
+ * @brief Inline variant of fast_fifo_get() for FAST_FIFO_DEFINE().
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[in]  mask     Buffer size minus one, expected to be a constant.
+ * @param[out] p_byte   Pointer to the location where the byte will be stored.
+ *                      If NULL, the byte will be eliminated from the FIFO.
+ *
+ * @retval E_OK     If the byte was returned.
+ * @retval E_EMPTY  If there are no more bytes in the queue.
+ */
+static inline fifo_error_t
+fast_fifo_const_get(fast_fifo_t * p_fifo, size_t mask, uint8_t * p_byte)
+{
+  if (fast_fifo_const_get_used(p_fifo, mask) == 0)
+  {
+    return E_EMPTY;
+  }
+
+  if (p_byte)
+  {
+    *p_byte = p_fifo->p_buf[p_fifo->read_pos & mask];
+  }
+  FAST_FIFO_MEMORY_BARRIER();
+  p_fifo->read_pos++;
+  return E_OK;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,200 @@
+/** ========================================================================= *
+ *
+ * @brief Host benchmark of the fast_fifo library.
+ *
+ * Reports the time per byte of each access function, on a 1 kB FIFO which is
+ * filled and drained in turns so every run crosses the end of the buffer.
+ * Then compares chunked write/read against byte-wise put/get moving the same
+ * 16, 64 and 256 byte chunks.
+ *
+ * Usage: bench_fast_fifo
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fast_fifo.h"
+
+/* Defines ================================================================== */
+#define FIFO_SIZE   (1024)
+#define BLOCK_SIZE  (FIFO_SIZE / 2)
+#define TOTAL_BYTES (64UL * 1024 * 1024)
+
+/* Variables ================================================================ */
+static uint8_t     buf[FIFO_SIZE];
+static fast_fifo_t fifo;
+
+/* Keeps the compiler from dropping the reads. */
+static volatile uint8_t sink;
+
+/* Private functions  ======================================================= */
+
+static double bench_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+static void bench_report(const char * p_name, double start)
+{
+  printf("%-8s %6.3f ns/byte\n", p_name, (bench_now() - start) / TOTAL_BYTES);
+}
+
+static void bench_put(void)
+{
+  double start = bench_now();
+
+  for (size_t done = 0; done < TOTAL_BYTES; done += BLOCK_SIZE)
+  {
+    for (size_t i = 0; i < BLOCK_SIZE; ++i)
+    {
+      fast_fifo_put(&fifo, (uint8_t)i);
+    }
+    fast_fifo_reset(&fifo);
+  }
+
+  bench_report("put", start);
+}
+
+static void bench_get(void)
+{
+  double  total = 0;
+  uint8_t byte  = 0;
+
+  for (size_t done = 0; done < TOTAL_BYTES; done += BLOCK_SIZE)
+  {
+    /* Only the get loop is timed. */
+    fifo.write_pos += BLOCK_SIZE;
+
+    double start = bench_now();
+    for (size_t i = 0; i < BLOCK_SIZE; ++i)
+    {
+      fast_fifo_get(&fifo, &byte);
+    }
+    total += bench_now() - start;
+  }
+  sink = byte;
+
+  printf("%-8s %6.3f ns/byte\n", "get", total / TOTAL_BYTES);
+}
+
+static void bench_write(void)
+{
+  static uint8_t src[BLOCK_SIZE];
+  double         start = bench_now();
+
+  for (size_t done = 0; done < TOTAL_BYTES; done += BLOCK_SIZE)
+  {
+    fast_fifo_write(&fifo, src, BLOCK_SIZE);
+    fifo.read_pos = fifo.write_pos;
+  }
+
+  bench_report("write", start);
+}
+
+static void bench_read(void)
+{
+  static uint8_t dst[BLOCK_SIZE];
+  double         start = bench_now();
+
+  for (size_t done = 0; done < TOTAL_BYTES; done += BLOCK_SIZE)
+  {
+    size_t length = BLOCK_SIZE;
+
+    fifo.write_pos += BLOCK_SIZE;
+    fast_fifo_read(&fifo, dst, &length);
+  }
+  sink = dst[0];
+
+  bench_report("read", start);
+}
+
+static void bench_peek(void)
+{
+  uint8_t byte  = 0;
+  uint8_t sum   = 0;
+  double  start;
+
+  fast_fifo_reset(&fifo);
+  fifo.write_pos = FIFO_SIZE - 1;
+
+  start = bench_now();
+  for (size_t done = 0; done < TOTAL_BYTES; done += BLOCK_SIZE)
+  {
+    for (size_t i = 0; i < BLOCK_SIZE; ++i)
+    {
+      fast_fifo_peek(&fifo, i, &byte);
+      sum += byte;
+    }
+  }
+  sink = sum;
+
+  bench_report("peek", start);
+}
+
+/**
+ * @brief Moves chunks through the FIFO, segmented or byte by byte.
+ */
+static void bench_chunks(size_t chunk)
+{
+  static uint8_t src[256];
+  static uint8_t dst[256];
+  double         bytewise;
+  double         start;
+
+  fast_fifo_reset(&fifo);
+
+  /* Reference, one put/get call per byte. */
+  start = bench_now();
+  for (size_t done = 0; done < TOTAL_BYTES; done += chunk)
+  {
+    for (size_t i = 0; i < chunk; ++i)
+    {
+      fast_fifo_put(&fifo, src[i]);
+    }
+    for (size_t i = 0; i < chunk; ++i)
+    {
+      fast_fifo_get(&fifo, &dst[i]);
+    }
+  }
+  bytewise = (bench_now() - start) / TOTAL_BYTES;
+
+  start = bench_now();
+  for (size_t done = 0; done < TOTAL_BYTES; done += chunk)
+  {
+    size_t length = chunk;
+
+    fast_fifo_write(&fifo, src, chunk);
+    fast_fifo_read(&fifo, dst, &length);
+  }
+  sink = dst[0];
+
+  printf("chunk %3u B  put/get %6.3f ns/byte  write/read %6.3f ns/byte\n",
+         (unsigned int)chunk, bytewise, (bench_now() - start) / TOTAL_BYTES);
+}
+
+/* Shared functions ========================================================= */
+int main(void)
+{
+  if (fast_fifo_init(&fifo, buf, sizeof(buf)) != E_OK)
+  {
+    return EXIT_FAILURE;
+  }
+
+  bench_put();
+  bench_get();
+  bench_write();
+  bench_read();
+  bench_peek();
+
+  bench_chunks(16);
+  bench_chunks(64);
+  bench_chunks(256);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,436 @@
+/** ========================================================================= *
+ *
+ * @brief Host unit test of the fast_fifo library.
+ *
+ * Runs randomized operations against fast_fifo and a plain reference deque
+ * and compares every result, then checks the edge cases one by one.
+ *
+ * Usage: test_fast_fifo [seed]
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fast_fifo.h"
+
+/* Defines ================================================================== */
+#define MODEL_SIZE      (4096)
+#define RANDOM_STEPS    (200000)
+#define MAX_TRANSFER    (300)
+
+/* Macros =================================================================== */
+#define CHECK(__cond)                                                         \
+  do                                                                          \
+  {                                                                           \
+    if (!(__cond))                                                            \
+    {                                                                         \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #__cond);       \
+      failures++;                                                             \
+    }                                                                         \
+  } while (0)
+
+/* Types ==================================================================== */
+
+/**
+ * @brief Reference deque, positions only grow.
+ */
+typedef struct
+{
+  uint8_t data[MODEL_SIZE];
+  size_t  head;
+  size_t  tail;
+  size_t  capacity;
+} model_t;
+
+/* Variables ================================================================ */
+static unsigned int failures;
+static uint32_t     random_state = 1;
+
+/* Const-mask helpers are checked against the same model. */
+FAST_FIFO_DEFINE(const_fifo, 64);
+
+/* Private functions  ======================================================= */
+
+static uint32_t random_next(void)
+{
+  /* xorshift32, reproducible on every host. */
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+static size_t model_used(const model_t * p_model)
+{
+  return p_model->tail - p_model->head;
+}
+
+static void model_push(model_t * p_model, uint8_t byte)
+{
+  p_model->data[p_model->tail++ % MODEL_SIZE] = byte;
+}
+
+static uint8_t model_at(const model_t * p_model, size_t index)
+{
+  return p_model->data[(p_model->head + index) % MODEL_SIZE];
+}
+
+static void model_pop(model_t * p_model, size_t amount)
+{
+  p_model->head += amount;
+}
+
+/**
+ * @brief Runs random operations on one buffer size.
+ */
+static void test_random(size_t size)
+{
+  uint8_t *   p_buf = malloc(size);
+  fast_fifo_t fifo;
+  model_t     model = { .head = 0, .tail = 0, .capacity = size - 1 };
+  uint8_t     src[MAX_TRANSFER];
+  uint8_t     dst[MAX_TRANSFER];
+
+  CHECK(fast_fifo_init(&fifo, p_buf, size) == E_OK);
+
+  for (uint32_t step = 0; step < RANDOM_STEPS; ++step)
+  {
+    size_t       used  = model_used(&model);
+    size_t       space = model.capacity - used;
+    size_t       amount = random_next() % MAX_TRANSFER;
+    fifo_error_t error;
+
+    switch (random_next() % 7)
+    {
+      case 0: /* put */
+      {
+        uint8_t byte = (uint8_t)random_next();
+
+        error = fast_fifo_put(&fifo, byte);
+        CHECK(error == ((space > 0) ? E_OK : E_NOMEM));
+        if (space > 0)
+        {
+          model_push(&model, byte);
+        }
+        break;
+      }
+
+      case 1: /* get */
+      {
+        uint8_t byte = 0;
+
+        error = fast_fifo_get(&fifo, &byte);
+        CHECK(error == ((used > 0) ? E_OK : E_EMPTY));
+        if (used > 0)
+        {
+          CHECK(byte == model_at(&model, 0));
+          model_pop(&model, 1);
+        }
+        break;
+      }
+
+      case 2: /* write, all or nothing */
+        for (size_t i = 0; i < amount; ++i)
+        {
+          src[i] = (uint8_t)random_next();
+        }
+
+        error = fast_fifo_write(&fifo, src, amount);
+        CHECK(error == ((amount <= space) ? E_OK : E_NOMEM));
+        for (size_t i = 0; (amount <= space) && (i < amount); ++i)
+        {
+          model_push(&model, src[i]);
+        }
+        break;
+
+      case 3: /* read, up to the requested amount */
+      {
+        size_t length   = amount;
+        size_t expected = (used < amount) ? used : amount;
+
+        error = fast_fifo_read(&fifo, dst, &length);
+        CHECK(error == ((expected > 0) ? E_OK : E_EMPTY));
+        CHECK(length == expected);
+        for (size_t i = 0; i < expected; ++i)
+        {
+          CHECK(dst[i] == model_at(&model, i));
+        }
+        model_pop(&model, expected);
+        break;
+      }
+
+      case 4: /* peek */
+      {
+        uint8_t byte  = 0;
+        size_t  index = random_next() % (size + 1);
+
+        error = fast_fifo_peek(&fifo, index, &byte);
+        CHECK(error == ((index < used) ? E_OK : E_EMPTY));
+        if (index < used)
+        {
+          CHECK(byte == model_at(&model, index));
+        }
+        break;
+      }
+
+      case 5: /* acquire/commit read of a part of the region */
+      {
+        uint8_t * p_data;
+        size_t    length;
+
+        error = fast_fifo_acquire_read(&fifo, &p_data, &length);
+        CHECK(error == ((used > 0) ? E_OK : E_EMPTY));
+        CHECK(length <= used);
+        CHECK((p_data + length) <= (p_buf + size));
+        if (error == E_OK)
+        {
+          length = (length > amount) ? amount : length;
+          for (size_t i = 0; i < length; ++i)
+          {
+            CHECK(p_data[i] == model_at(&model, i));
+          }
+          CHECK(fast_fifo_commit_read(&fifo, length) == E_OK);
+          model_pop(&model, length);
+        }
+        break;
+      }
+
+      case 6: /* acquire/commit write of a part of the region */
+      {
+        uint8_t * p_data;
+        size_t    length;
+
+        error = fast_fifo_acquire_write(&fifo, &p_data, &length);
+        CHECK(error == ((space > 0) ? E_OK : E_NOMEM));
+        CHECK(length <= space);
+        CHECK((p_data + length) <= (p_buf + size));
+        if (error == E_OK)
+        {
+          length = (length > amount) ? amount : length;
+          for (size_t i = 0; i < length; ++i)
+          {
+            p_data[i] = (uint8_t)random_next();
+            model_push(&model, p_data[i]);
+          }
+          CHECK(fast_fifo_commit_write(&fifo, length) == E_OK);
+        }
+        break;
+      }
+    }
+
+    CHECK(fast_fifo_get_available(&fifo) == model_used(&model));
+    CHECK(fast_fifo_get_free(&fifo) == (model.capacity - model_used(&model)));
+  }
+
+  free(p_buf);
+}
+
+/**
+ * @brief Random multi-producer writes, consumer checks the byte order.
+ */
+static void test_random_mp(void)
+{
+  uint8_t     buf[256];
+  fast_fifo_t fifo;
+  model_t     model = { .head = 0, .tail = 0, .capacity = sizeof(buf) - 1 };
+  uint8_t     src[MAX_TRANSFER];
+  uint8_t     dst[sizeof(buf)];
+
+  CHECK(fast_fifo_init(&fifo, buf, sizeof(buf)) == E_OK);
+
+  for (uint32_t step = 0; step < RANDOM_STEPS; ++step)
+  {
+    size_t amount = random_next() % 64;
+    size_t space  = model.capacity - model_used(&model);
+
+    if (random_next() & 1)
+    {
+      for (size_t i = 0; i < amount; ++i)
+      {
+        src[i] = (uint8_t)random_next();
+      }
+
+      CHECK(fast_fifo_write_mp(&fifo, src, amount) == ((amount <= space) ? E_OK : E_NOMEM));
+      for (size_t i = 0; (amount <= space) && (i < amount); ++i)
+      {
+        model_push(&model, src[i]);
+      }
+    }
+    else
+    {
+      size_t length = amount;
+
+      fast_fifo_read(&fifo, dst, &length);
+      CHECK(length == ((model_used(&model) < amount) ? model_used(&model) : amount));
+      for (size_t i = 0; i < length; ++i)
+      {
+        CHECK(dst[i] == model_at(&model, i));
+      }
+      model_pop(&model, length);
+    }
+
+    CHECK(fast_fifo_get_available(&fifo) == model_used(&model));
+  }
+}
+
+static void test_init(void)
+{
+  static const size_t bad_sizes[] = { 0, 3, 6, 100, 255, 257, 1000 };
+  uint8_t             buf[16];
+  fast_fifo_t         fifo;
+
+  CHECK(fast_fifo_init(NULL, buf, sizeof(buf)) == E_NULL);
+  CHECK(fast_fifo_init(&fifo, NULL, sizeof(buf)) == E_NULL);
+  CHECK(fast_fifo_deinit(NULL) == E_NULL);
+
+  for (size_t i = 0; i < (sizeof(bad_sizes) / sizeof(bad_sizes[0])); ++i)
+  {
+    CHECK(fast_fifo_init(&fifo, buf, bad_sizes[i]) == E_INVAL);
+  }
+
+  CHECK(fast_fifo_init(&fifo, buf, 1) == E_OK);
+  CHECK(fast_fifo_put(&fifo, 0x55) == E_NOMEM);
+  CHECK(fast_fifo_init(&fifo, buf, sizeof(buf)) == E_OK);
+  CHECK(fast_fifo_get_free(&fifo) == (sizeof(buf) - 1));
+}
+
+static void test_full_empty(void)
+{
+  uint8_t     buf[16];
+  uint8_t     data[16];
+  uint8_t     byte;
+  size_t      length;
+  fast_fifo_t fifo;
+
+  fast_fifo_init(&fifo, buf, sizeof(buf));
+
+  /* Empty FIFO refuses every read. */
+  length = sizeof(data);
+  CHECK(fast_fifo_get(&fifo, &byte) == E_EMPTY);
+  CHECK(fast_fifo_peek(&fifo, 0, &byte) == E_EMPTY);
+  CHECK(fast_fifo_read(&fifo, data, &length) == E_EMPTY);
+  CHECK(length == 0);
+  CHECK(fast_fifo_commit_read(&fifo, 1) == E_EMPTY);
+
+  /* One byte is always kept free. */
+  for (uint8_t i = 0; i < 15; ++i)
+  {
+    CHECK(fast_fifo_put(&fifo, i) == E_OK);
+  }
+  CHECK(fast_fifo_put(&fifo, 15) == E_NOMEM);
+  CHECK(fast_fifo_write(&fifo, data, 1) == E_NOMEM);
+  CHECK(fast_fifo_get_free(&fifo) == 0);
+  CHECK(fast_fifo_commit_write(&fifo, 1) == E_NOMEM);
+
+  /* Reset drops everything. */
+  CHECK(fast_fifo_reset(&fifo) == E_OK);
+  CHECK(fast_fifo_get_available(&fifo) == 0);
+}
+
+static void test_wraparound(void)
+{
+  uint8_t     buf[16];
+  uint8_t     data[16];
+  uint8_t *   p_data;
+  size_t      length;
+  fast_fifo_t fifo;
+
+  fast_fifo_init(&fifo, buf, sizeof(buf));
+
+  /* Move the positions to offset 10. */
+  for (uint8_t i = 0; i < 10; ++i)
+  {
+    data[i] = i;
+  }
+  CHECK(fast_fifo_write(&fifo, data, 10) == E_OK);
+  length = 10;
+  CHECK(fast_fifo_read(&fifo, data, &length) == E_OK);
+
+  /* Twelve bytes span the end of the buffer. */
+  for (uint8_t i = 0; i < 12; ++i)
+  {
+    data[i] = (uint8_t)(0xA0 + i);
+  }
+  CHECK(fast_fifo_write(&fifo, data, 12) == E_OK);
+
+  /* In place access exposes the first segment only. */
+  CHECK(fast_fifo_acquire_read(&fifo, &p_data, &length) == E_OK);
+  CHECK(p_data == &buf[10]);
+  CHECK(length == 6);
+
+  CHECK(fast_fifo_acquire_write(&fifo, &p_data, &length) == E_OK);
+  CHECK(p_data == &buf[6]);
+  CHECK(length == 3);
+
+  uint8_t byte;
+  CHECK(fast_fifo_peek(&fifo, 7, &byte) == E_OK);
+  CHECK(byte == 0xA7);
+
+  memset(data, 0, sizeof(data));
+  length = sizeof(data);
+  CHECK(fast_fifo_read(&fifo, data, &length) == E_OK);
+  CHECK(length == 12);
+  for (uint8_t i = 0; i < 12; ++i)
+  {
+    CHECK(data[i] == (uint8_t)(0xA0 + i));
+  }
+
+  /* Positions keep counting past SIZE_MAX. */
+  fifo.read_pos  = SIZE_MAX - 3;
+  fifo.write_pos = SIZE_MAX - 3;
+  CHECK(fast_fifo_write(&fifo, data, 8) == E_OK);
+  CHECK(fast_fifo_get_available(&fifo) == 8);
+  length = sizeof(data);
+  CHECK(fast_fifo_read(&fifo, data, &length) == E_OK);
+  CHECK(length == 8);
+  CHECK(data[7] == 0xA7);
+}
+
+static void test_const(void)
+{
+  uint8_t byte;
+
+  for (uint8_t i = 0; i < 63; ++i)
+  {
+    CHECK(const_fifo_put(i) == E_OK);
+  }
+  CHECK(const_fifo_put(63) == E_NOMEM);
+  CHECK(const_fifo_get_available() == 63);
+  CHECK(const_fifo_get_free() == 0);
+
+  for (uint8_t i = 0; i < 63; ++i)
+  {
+    CHECK((const_fifo_get(&byte) == E_OK) && (byte == i));
+  }
+  CHECK(const_fifo_get(&byte) == E_EMPTY);
+}
+
+/* Shared functions ========================================================= */
+int main(int argc, char * argv[])
+{
+  static const size_t sizes[] = { 2, 4, 16, 64, 256, 2048 };
+
+  if (argc > 1)
+  {
+    random_state = (uint32_t)strtoul(argv[1], NULL, 0);
+    random_state = random_state ? random_state : 1;
+  }
+  printf("seed %lu\n", (unsigned long)random_state);
+
+  test_init();
+  test_full_empty();
+  test_wraparound();
+  test_const();
+
+  for (size_t i = 0; i < (sizeof(sizes) / sizeof(sizes[0])); ++i)
+  {
+    test_random(sizes[i]);
+  }
+  test_random_mp();
+
+  printf("%s, %u failures\n", failures ? "FAILED" : "PASSED", failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
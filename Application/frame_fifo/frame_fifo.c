@@ -0,0 +1,105 @@
+/* Includes ================================================================= */
+#include "frame_fifo.h"
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Private functions  ======================================================= */
+
+/**
+ * @brief Returns the number of records queued in the FIFO.
+ */
+static size_t framebuf_get_used(frame_fifo_t * p_fifo)
+{
+  size_t r_position = p_fifo->read_pos;
+  size_t w_position = p_fifo->write_pos;
+  FAST_FIFO_MEMORY_BARRIER();
+  return (p_fifo->buf_size_mask & (w_position - r_position));
+}
+
+/* Shared functions ========================================================= */
+fifo_error_t
+frame_fifo_init(frame_fifo_t * p_fifo, can_frame_t * p_buf, size_t count)
+{
+  if ((p_fifo == NULL) || (p_buf == NULL))
+  {
+    return E_NULL;
+  }
+
+  if (!FAST_FIFO_IS_POWER_OF_TWO(count))
+  {
+    return E_INVAL;
+  }
+
+  p_fifo->p_buf          = p_buf;
+  p_fifo->buf_size_mask  = count - 1;
+  p_fifo->read_pos       = 0;
+  p_fifo->write_pos      = 0;
+  p_fifo->overflow_count = 0;
+  p_fifo->high_water     = 0;
+
+  return E_OK;
+}
+
+size_t frame_fifo_get_available(frame_fifo_t * p_fifo)
+{
+  return framebuf_get_used(p_fifo);
+}
+
+can_frame_t * frame_fifo_acquire_write(frame_fifo_t * p_fifo)
+{
+  can_frame_t * p_frame = NULL;
+
+  if (framebuf_get_used(p_fifo) < p_fifo->buf_size_mask)
+  {
+    p_frame = &p_fifo->p_buf[p_fifo->write_pos & p_fifo->buf_size_mask];
+  }
+  else
+  {
+    p_fifo->overflow_count++;
+  }
+
+  return p_frame;
+}
+
+void frame_fifo_commit_write(frame_fifo_t * p_fifo)
+{
+  FAST_FIFO_MEMORY_BARRIER();
+  p_fifo->write_pos++;
+
+  size_t used = p_fifo->buf_size_mask & (p_fifo->write_pos - p_fifo->read_pos);
+  if (used > p_fifo->high_water)
+  {
+    p_fifo->high_water = used;
+  }
+}
+
+const can_frame_t * frame_fifo_acquire_read(frame_fifo_t * p_fifo)
+{
+  const can_frame_t * p_frame = NULL;
+
+  if (framebuf_get_used(p_fifo) != 0)
+  {
+    p_frame = &p_fifo->p_buf[p_fifo->read_pos & p_fifo->buf_size_mask];
+  }
+
+  return p_frame;
+}
+
+void frame_fifo_commit_read(frame_fifo_t * p_fifo)
+{
+  FAST_FIFO_MEMORY_BARRIER();
+  p_fifo->read_pos++;
+}
+
+uint32_t frame_fifo_get_overflow_count(frame_fifo_t * p_fifo)
+{
+  return p_fifo->overflow_count;
+}
+
+size_t frame_fifo_get_high_water(frame_fifo_t * p_fifo)
+{
+  return p_fifo->high_water;
+}
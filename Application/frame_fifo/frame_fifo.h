@@ -0,0 +1,277 @@
+/** ========================================================================= *
+ *
+ * @brief Fixed-size CAN frame record FIFO.
+ *
+ *  ========================================================================= */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fast_fifo.h"
+
+/* Macros =================================================================== */
+#define CAN_FRAME_FLAG_IDE (0x01U) /**< Frame has an extended (29-bit) ID. */
+#define CAN_FRAME_FLAG_RTR (0x02U) /**< Frame is a remote request. */
+
+/**
+ * @brief Defines a frame FIFO instance with compile-time record count.
+ *
+ * The count is checked to be a power of two at compile time, the instance is
+ * statically initialized (no frame_fifo_init() call is needed), and the
+ * following helpers with the mask baked in as a constant are generated:
+ *   <name>_get_available(), <name>_acquire_write(), <name>_commit_write(),
+ *   <name>_acquire_read(), <name>_commit_read().
+ * The instance is a regular frame_fifo_t, so all frame_fifo_*() functions may
+ * be used on it as well.
+ *
+ * @param __name   Name of the frame_fifo_t instance.
+ * @param __count  Amount of records, must be a power of two.
+ */
+#define FRAME_FIFO_DEFINE(__name, __count)                                    \
+  _Static_assert(FAST_FIFO_IS_POWER_OF_TWO(__count),                          \
+                 #__name " count must be a power of two");                    \
+  static can_frame_t  __name##_buffer[(__count)];                             \
+  static frame_fifo_t __name = {                                              \
+    .p_buf = __name##_buffer, .buf_size_mask = (__count) - 1                  \
+  };                                                                          \
+  static inline size_t __name##_get_available(void)                           \
+  {                                                                           \
+    return frame_fifo_const_get_used(&__name, (__count) - 1);                 \
+  }                                                                           \
+  static inline can_frame_t * __name##_acquire_write(void)                    \
+  {                                                                           \
+    return frame_fifo_const_acquire_write(&__name, (__count) - 1);            \
+  }                                                                           \
+  static inline void __name##_commit_write(void)                              \
+  {                                                                           \
+    frame_fifo_const_commit_write(&__name, (__count) - 1);                    \
+  }                                                                           \
+  static inline const can_frame_t * __name##_acquire_read(void)               \
+  {                                                                           \
+    return frame_fifo_const_acquire_read(&__name, (__count) - 1);             \
+  }                                                                           \
+  static inline void __name##_commit_read(void)                               \
+  {                                                                           \
+    FAST_FIFO_MEMORY_BARRIER();                                               \
+    __name.read_pos++;                                                        \
+  }
+
+/* Enums ==================================================================== */
+typedef enum {
+	CAN_BUS_HS = 0, /**< High speed bus (CAN2, PB12/PB13). */
+	CAN_BUS_MS,     /**< Medium speed bus (CAN1, PB8/PB9). */
+	CAN_BUS_MM,     /**< Multimedia bus (CAN2 remap, PB5/PB6). */
+	CAN_BUS_COUNT
+} can_bus_t;
+
+/* Types ==================================================================== */
+
+/**
+ * @brief Received (or transmitted) CAN frame record.
+ *
+ * Word aligned and 20 bytes long, so a record is copied with a few word
+ * accesses and a power-of-two amount of records fits the FIFO exactly.
+ */
+typedef struct
+{
+  uint32_t timestamp; /**< Capture time in microseconds, see timebase. */
+  uint32_t id;        /**< Standard or extended identifier. */
+  uint8_t  flags;     /**< CAN_FRAME_FLAG_* bits. */
+  uint8_t  dlc;       /**< Data length code. */
+  uint8_t  bus;       /**< Source bus, see can_bus_t. */
+  uint8_t  reserved;  /**< Padding, keeps the payload word aligned. */
+  uint8_t  data[8];   /**< Payload, only dlc bytes are meaningful. */
+} can_frame_t;
+
+_Static_assert(sizeof(can_frame_t) == 20, "can_frame_t must stay 20 bytes");
+
+/**
+ * @brief The frame FIFO control block.
+ *
+ * Same single-producer/single-consumer scheme as fast_fifo_t, but every slot
+ * holds one can_frame_t. The producer (ISR) fills the next slot in place and
+ * commits it, the consumer (main loop) processes the oldest slot in place and
+ * releases it.
+ */
+typedef struct
+{
+  can_frame_t *     p_buf;          /**< Pointer to the record memory. */
+  volatile size_t   read_pos;       /**< The read position in records. */
+  volatile size_t   write_pos;      /**< The write position in records. */
+  size_t            buf_size_mask;  /**< Mask used to calculate the index. */
+  volatile uint32_t overflow_count; /**< Records dropped because FIFO was full. */
+  volatile size_t   high_water;     /**< Maximum amount of records queued. */
+} frame_fifo_t;
+
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+
+/**
+ * @brief Function for initializing the frame FIFO.
+ *
+ * @note The amount of records must be a power of two, one record is always
+ *       kept free to tell full and empty states apart.
+ *
+ * @param[out] p_fifo   FIFO object.
+ * @param[in]  p_buf    Record storage.
+ * @param[in]  count    Amount of records in p_buf.
+ *
+ * @retval     E_OK    If initialization was successful.
+ * @retval     E_NULL  If a NULL pointer is provided as FIFO or storage.
+ * @retval     E_INVAL If the amount of records is not a power of two.
+ */
+fifo_error_t
+frame_fifo_init(frame_fifo_t * p_fifo, can_frame_t * p_buf, size_t count);
+
+/**
+ * @brief Returns the amount of records queued in the FIFO.
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ *
+ * @return  Number of records available in the FIFO.
+ */
+size_t frame_fifo_get_available(frame_fifo_t * p_fifo);
+
+/**
+ * @brief Returns the next free record slot to be filled by the producer.
+ *
+ * If the FIFO is full the overflow counter is incremented and NULL is
+ * returned, the frame should be dropped by the caller.
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ *
+ * @return  Pointer to the free slot, or NULL if the FIFO is full.
+ */
+can_frame_t * frame_fifo_acquire_write(frame_fifo_t * p_fifo);
+
+/**
+ * @brief Publishes the slot returned by frame_fifo_acquire_write().
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ */
+void frame_fifo_commit_write(frame_fifo_t * p_fifo);
+
+/**
+ * @brief Returns the oldest record in the FIFO without removing it.
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ *
+ * @return  Pointer to the record, or NULL if the FIFO is empty.
+ */
+const can_frame_t * frame_fifo_acquire_read(frame_fifo_t * p_fifo);
+
+/**
+ * @brief Releases the record returned by frame_fifo_acquire_read().
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ */
+void frame_fifo_commit_read(frame_fifo_t * p_fifo);
+
+/**
+ * @brief Returns the amount of records dropped because the FIFO was full.
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ *
+ * @return  Overflow counter.
+ */
+uint32_t frame_fifo_get_overflow_count(frame_fifo_t * p_fifo);
+
+/**
+ * @brief Returns the maximum amount of records that were queued at once.
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ *
+ * @return  High-water mark.
+ */
+size_t frame_fifo_get_high_water(frame_fifo_t * p_fifo);
+
+/* Inline functions ========================================================= */
+
+/**
+ * @brief Inline variant of frame_fifo_get_available() for FRAME_FIFO_DEFINE().
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[in]  mask     Record count minus one, expected to be a constant.
+ *
+ * @return  Number of records available in the FIFO.
+ */
+static inline size_t
+frame_fifo_const_get_used(const frame_fifo_t * p_fifo, size_t mask)
+{
+  size_t r_position = p_fifo->read_pos;
+  size_t w_position = p_fifo->write_pos;
+  FAST_FIFO_MEMORY_BARRIER();
+  return (mask & (w_position - r_position));
+}
+
+/**
+ * @brief Inline variant of frame_fifo_acquire_write() for FRAME_FIFO_DEFINE().
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[in]  mask     Record count minus one, expected to be a constant.
+ *
+ * @return  Pointer to the free slot, or NULL if the FIFO is full.
+ */
+static inline can_frame_t *
+frame_fifo_const_acquire_write(frame_fifo_t * p_fifo, size_t mask)
+{
+  if (frame_fifo_const_get_used(p_fifo, mask) >= mask)
+  {
+    p_fifo->overflow_count++;
+    return NULL;
+  }
+
+  return &p_fifo->p_buf[p_fifo->write_pos & mask];
+}
+
+/**
+ * @brief Inline variant of frame_fifo_commit_write() for FRAME_FIFO_DEFINE().
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[in]  mask     Record count minus one, expected to be a constant.
+ */
+static inline void
+frame_fifo_const_commit_write(frame_fifo_t * p_fifo, size_t mask)
+{
+  FAST_FIFO_MEMORY_BARRIER();
+  p_fifo->write_pos++;
+
+  size_t used = mask & (p_fifo->write_pos - p_fifo->read_pos);
+  if (used > p_fifo->high_water)
+  {
+    p_fifo->high_water = used;
+  }
+}
+
+/**
+ * @brief Inline variant of frame_fifo_acquire_read() for FRAME_FIFO_DEFINE().
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[in]  mask     Record count minus one, expected to be a constant.
+ *
+ * @return  Pointer to the record, or NULL if the FIFO is empty.
+ */
+static inline const can_frame_t *
+frame_fifo_const_acquire_read(const frame_fifo_t * p_fifo, size_t mask)
+{
+  if (frame_fifo_const_get_used(p_fifo, mask) == 0)
+  {
+    return NULL;
+  }
+
+  return &p_fifo->p_buf[p_fifo->read_pos & mask];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
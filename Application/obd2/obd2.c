@@ -2,11 +2,20 @@
 #include "obd2.h"
 #include "console.h"
 #include "main.h"
+#include "can.h"
 
 /* Private variables ---------------------------------------------------------*/
-extern CAN_HandleTypeDef hcan2; // CAN Data Transmit Setup
 static uint32_t last_request_time = 0;
 
+/* PIDs polled in round robin, one request per period */
+static uint8_t pid_list[OBD2_PID_LIST_MAX];
+static uint8_t pid_count = 0;
+static uint8_t pid_index = 0;
+static uint32_t request_period = PIDS_UPDATE_PERIOD;
+
+/* One-shot request, 0 if none */
+static uint8_t pid_single = 0;
+
 int16_t obd2_parse_packet(uint8_t packet[], uint8_t len)
 {
 	//uint8_t length = RxData[0];
@@ -102,16 +111,16 @@ int16_t obd2_parse_packet(uint8_t packet[], uint8_t len)
 }
 
 void obd2_request_pid(uint8_t pid){
-	HAL_StatusTypeDef	TxStatus = HAL_OK;
-	CAN_TxHeaderTypeDef	TxHeader;
-	uint32_t			TxMailbox;
-	uint8_t				TxData[8];
-
-	TxHeader.IDE = CAN_ID_STD;
-	TxHeader.StdId = 0x7DF;
-	TxHeader.RTR = CAN_RTR_DATA;
-	TxHeader.DLC = 8;
-	TxHeader.TransmitGlobalTime = DISABLE;
+	can_frame_t	TxFrame = { 0 };
+	uint8_t		*TxData = TxFrame.data;
+
+	/* Requests would disturb the bus the logger is passively attached to */
+	if(Can_IsListenOnly()){
+		return;
+	}
+
+	TxFrame.id = 0x7DF;
+	TxFrame.dlc = 8;
 	TxData[0] = 0x02;	// Payload length
 	TxData[1] = 0x01;	// Standart request
 	TxData[2] = pid;	// PID field
@@ -121,15 +130,14 @@ void obd2_request_pid(uint8_t pid){
 	TxData[6] = 0x55;
 	TxData[7] = 0x55;
 
-	TxStatus = HAL_CAN_AddTxMessage(&hcan2, &TxHeader, TxData, &TxMailbox);
-	if(TxStatus == HAL_OK){
+	/* Queued if all mailboxes are busy, lost only if the queue is full too */
+	if(Can_Transmit(&hcan2, &TxFrame) == HAL_OK){
 		console_print("%.8lu TX: ID=0x%X DLC=%lu %.2X %.2X %.2X %.2X %.2X %.2X %.2X %.2X\r\n",
-					HAL_GetTick(), TxHeader.StdId, TxHeader.DLC,
+					timebase_get_us(), TxFrame.id, (uint32_t)TxFrame.dlc,
 					TxData[0], TxData[1], TxData[2], TxData[3], TxData[4], TxData[5], TxData[6], TxData[7]);
 	}
 	else{
-		console_print("%.8lu TX ERROR! CODE=0x%.8X\r\n", HAL_GetTick(), HAL_CAN_GetError(&hcan2));
-		HAL_CAN_ResetError(&hcan2);
+		console_print("%.8lu TX ERROR! QUEUE FULL\r\n", timebase_get_us());
 	}
 
 	last_request_time = HAL_GetTick();
@@ -138,3 +146,41 @@ void obd2_request_pid(uint8_t pid){
 uint32_t obd2_getLastRequestTime(){
 	return last_request_time;
 }
+
+void obd2_set_pid_list(const uint8_t *pids, uint8_t count){
+	if(count > OBD2_PID_LIST_MAX){
+		count = OBD2_PID_LIST_MAX;
+	}
+
+	pid_count = 0;
+	for(uint8_t i = 0; i < count; i++){
+		pid_list[i] = pids[i];
+	}
+	pid_index = 0;
+	pid_count = count;
+}
+
+void obd2_set_request_period(uint32_t period_ms){
+	request_period = period_ms;
+}
+
+void obd2_request_once(uint8_t pid){
+	pid_single = pid;
+}
+
+void obd2_main(void){
+	if(pid_single){
+		obd2_request_pid(pid_single);
+		pid_single = 0;
+		return;
+	}
+
+	/* Polling holds in listen only mode, so it resumes on schedule with the
+	 * PID it stopped at instead of spinning through the list */
+	if(pid_count && !Can_IsListenOnly() && (HAL_GetTick() - last_request_time) >= request_period){
+		if(pid_index >= pid_count){
+			pid_index = 0;
+		}
+		obd2_request_pid(pid_list[pid_index++]);
+	}
+}
@@ -5,5 +5,11 @@
 
 #include "obd2_pids.h"
 
+#define OBD2_PID_LIST_MAX		(16)
+
 int16_t obd2_parse_packet(uint8_t packet[], uint8_t len);
 void obd2_request_pid(uint8_t pid);
+void obd2_request_once(uint8_t pid);
+void obd2_set_pid_list(const uint8_t *pids, uint8_t count);
+void obd2_set_request_period(uint32_t period_ms);
+void obd2_main(void);
@@ -0,0 +1,225 @@
+#include "replay.h"
+
+/* Platform includes */
+#include "main.h"
+#include "can.h"
+#include "console.h"
+#include "stream.h"
+
+/* Frames between USB and the TX queues, must be a power of two */
+#define REPLAY_FIFO_SIZE			(128)
+
+/* Frames buffered before the first one is sent, so USB hiccups early in the
+ * trace do not starve the bus */
+#define REPLAY_PREFILL				(REPLAY_FIFO_SIZE / 2)
+
+/* Delay from the start of playback to the first frame */
+#define REPLAY_LEAD_US				(1000UL)
+
+/* Frames handed over later than that count as late */
+#define REPLAY_LATE_US				(100)
+
+/* Host silent that long without an end record, the trace is considered
+ * complete and the remaining frames are played */
+#define REPLAY_IDLE_TIMEOUT			(2000)
+
+typedef enum {
+	REPLAY_IDLE = 0,
+	REPLAY_LOADING,		/* host bytes are trace records, playback runs alongside */
+	REPLAY_DRAINING		/* trace ended, remaining frames are played */
+} replay_state_t;
+
+FRAME_FIFO_DEFINE(replay_fifo, REPLAY_FIFO_SIZE);
+
+static replay_state_t replay_state;
+static bool replay_playing;
+static uint32_t input_tick;
+
+/* Trace time of the first frame and local time it is due at */
+static uint32_t trace_start;
+static uint32_t local_start;
+
+/* COBS record being received, longer ones are counted as bad */
+static uint8_t record[STREAM_REPLAY_MAX_LENGTH];
+static size_t record_length;
+
+/* Well formed frames taken from the ring, sent or skipped */
+static uint32_t frame_index;
+static uint32_t frame_count;
+static uint32_t skip_count;
+static uint32_t late_count;
+static uint32_t bad_count;
+static uint32_t report_lost_count;
+static int64_t error_sum;
+static int32_t error_max;
+
+/* Starts loading a trace, host waits for the command result before sending it */
+bool replay_start(void){
+	if(replay_state != REPLAY_IDLE || Can_IsListenOnly()){
+		return false;
+	}
+
+	frame_fifo_init(&replay_fifo, replay_fifo_buffer, REPLAY_FIFO_SIZE);
+	record_length = 0;
+	replay_playing = false;
+	frame_index = 0;
+	frame_count = 0;
+	skip_count = 0;
+	late_count = 0;
+	bad_count = 0;
+	report_lost_count = 0;
+	error_sum = 0;
+	error_max = 0;
+	input_tick = HAL_GetTick();
+
+	replay_state = REPLAY_LOADING;
+	return true;
+}
+
+bool replay_is_loading(void){
+	return (replay_state == REPLAY_LOADING);
+}
+
+static void replay_record(void){
+	uint8_t raw[STREAM_REPLAY_MAX_LENGTH];
+	size_t length = 0;
+	can_frame_t *p_frame;
+
+	if(record_length <= sizeof(record)){
+		length = stream_decode(raw, record, record_length);
+	}
+
+	if(length == 1 && raw[0] == ((STREAM_RECORD_REPLAY << 4) | STREAM_REPLAY_END)){
+		replay_state = REPLAY_DRAINING;
+		return;
+	}
+
+	/* Caller made sure there is a free slot */
+	p_frame = replay_fifo_acquire_write();
+	if(length == 0 || !stream_decode_replay(raw, length, p_frame)){
+		bad_count++;
+		return;
+	}
+	replay_fifo_commit_write();
+}
+
+/* Takes bytes as long as the frame fifo has room, the rest stays in the
+ * console fifo and USB holds the host off until it is consumed */
+size_t replay_input(const uint8_t *p_data, size_t length){
+	size_t consumed = 0;
+
+	input_tick = HAL_GetTick();
+
+	while(consumed < length && replay_state == REPLAY_LOADING &&
+			replay_fifo_get_available() < REPLAY_FIFO_SIZE - 1){
+		uint8_t byte = p_data[consumed++];
+
+		if(byte != 0x00){
+			if(record_length < sizeof(record)){
+				record[record_length] = byte;
+			}
+			if(record_length <= sizeof(record)){
+				record_length++;
+			}
+		}
+		else if(record_length){
+			replay_record();
+			record_length = 0;
+		}
+	}
+
+	return consumed;
+}
+
+static void replay_account(int32_t error){
+	uint8_t report[STREAM_REPLAY_REPORT_MAX_LENGTH];
+
+	/* Per-frame reports only make sense to a host parsing binary records */
+	if(stream_get_format() == STREAM_FORMAT_BINARY){
+		if(console_get_free() >= sizeof(report)){
+			console_write(report, stream_encode_replay_report(report, frame_index, error));
+		}
+		else{
+			report_lost_count++;
+		}
+	}
+
+	frame_count++;
+	error_sum += error;
+	if(error > error_max){
+		error_max = error;
+	}
+	if(error > REPLAY_LATE_US){
+		late_count++;
+	}
+}
+
+static void replay_finish(void){
+	int32_t error_avg = frame_count ? (int32_t)(error_sum / frame_count) : 0;
+
+	console_print("REPLAY DONE FRAMES=%lu LATE=%lu ERR_AVG=%ldus ERR_MAX=%ldus BAD=%lu SKIP=%lu LOST=%lu\r\n",
+				  frame_count, late_count, error_avg, error_max, bad_count, skip_count, report_lost_count);
+	replay_state = REPLAY_IDLE;
+}
+
+/* Hands every due frame to the TX queue of its bus. Scheduling is polled, so
+ * the error is bounded by the main loop period, it is measured and reported
+ * per frame instead of being hidden. */
+void replay_main(void){
+	const can_frame_t *p_frame;
+
+	if(replay_state == REPLAY_IDLE){
+		return;
+	}
+
+	if(replay_state == REPLAY_LOADING && HAL_GetTick() - input_tick >= REPLAY_IDLE_TIMEOUT){
+		replay_state = REPLAY_DRAINING;
+	}
+
+	if(!replay_playing){
+		if(replay_state == REPLAY_LOADING && replay_fifo_get_available() < REPLAY_PREFILL){
+			return;
+		}
+
+		p_frame = replay_fifo_acquire_read();
+		if(p_frame == NULL){
+			replay_finish();
+			return;
+		}
+
+		trace_start = p_frame->timestamp;
+		local_start = timebase_get_us() + REPLAY_LEAD_US;
+		replay_playing = true;
+	}
+
+	while((p_frame = replay_fifo_acquire_read()) != NULL){
+		CAN_HandleTypeDef *p_can = (p_frame->bus == CAN_BUS_MS) ? &hcan1 : &hcan2;
+		uint32_t due = local_start + (p_frame->timestamp - trace_start);
+		int32_t error = (int32_t)(timebase_get_us() - due);
+
+		if(error < 0){
+			break;
+		}
+
+		/* CAN2 serves either the HS or the MM bus, frames of the other one
+		 * must not end up on the wrong wires. In listen-only mode frames
+		 * would only loop back internally, they are not counted as sent */
+		if(Can_IsListenOnly() || Can_GetBus(p_can) != p_frame->bus){
+			skip_count++;
+		}
+		/* Full TX queue, the frame is retried on the next pass and its error grows */
+		else if(Can_Transmit(p_can, p_frame) != HAL_OK){
+			break;
+		}
+		else{
+			replay_account(error);
+		}
+
+		frame_index++;
+		replay_fifo_commit_read();
+	}
+
+	if(p_frame == NULL && replay_state == REPLAY_DRAINING){
+		replay_finish();
+	}
+}
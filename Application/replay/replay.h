@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+bool replay_start(void);
+bool replay_is_loading(void);
+size_t replay_input(const uint8_t *p_data, size_t length);
+void replay_main(void);
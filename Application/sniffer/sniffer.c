@@ -0,0 +1,208 @@
+#include "sniffer.h"
+
+/* Platform includes */
+#include "main.h"
+#include "console.h"
+#include "obd2.h"
+#include "can_format.h"
+#include "stream.h"
+#include "can_stats.h"
+#include "capture.h"
+
+/* Records between CAN RX ISR and main loop, must be a power of two */
+#define SNIFFER_RX_FIFO_SIZE		(64)
+
+/* Longest output per frame (RX line + decoded PID line), processing waits
+ * until console fits it */
+#define SNIFFER_LINE_MAX_LENGTH		(96)
+
+FRAME_FIFO_DEFINE(rx_fifo, SNIFFER_RX_FIFO_SIZE);
+static uint32_t reported_overflow_count;
+
+/* Next statistics entry to send, -1 while no dump is running */
+static int32_t stats_dump_index = -1;
+
+/* Next snapshot entry to send, -1 while no dump is running */
+static int32_t snapshot_dump_index = -1;
+
+/* Next captured frame to send, -1 while no dump is running. A window is
+ * sent once on its own as soon as it freezes */
+static int32_t capture_dump_index = -1;
+static uint32_t capture_dumped_count;
+
+/* Delta mode forwards only frames whose payload changed, plus one frame per
+ * ID and heartbeat period */
+static bool delta_enabled;
+static uint32_t delta_heartbeat_us;
+
+void sniffer_init(void){
+	reported_overflow_count = 0;
+	can_stats_reset();
+}
+
+/* Table is sent in the main loop as console space allows */
+void sniffer_dump_stats(void){
+	stats_dump_index = 0;
+}
+
+/* Latest payload of every ID, sent like the statistics table */
+void sniffer_dump_snapshot(void){
+	snapshot_dump_index = 0;
+}
+
+/* Frozen capture window again, e.g. after the host missed it */
+bool sniffer_dump_capture(void){
+	if(capture_get_state() != CAPTURE_STATE_FROZEN){
+		return false;
+	}
+
+	capture_dump_index = 0;
+	return true;
+}
+
+void sniffer_set_delta(bool enable, uint32_t heartbeat_ms){
+	delta_heartbeat_us = heartbeat_ms * 1000;
+	delta_enabled = enable;
+}
+
+/* A running capture takes every frame, live output is off meanwhile */
+static bool sniffer_capturing(void){
+	capture_state_t state = capture_get_state();
+
+	return (state == CAPTURE_STATE_ARMED || state == CAPTURE_STATE_TRIGGERED);
+}
+
+static void sniffer_capture_main(void){
+	uint8_t record[STREAM_CAPTURE_MAX_LENGTH];
+
+	capture_tick(timebase_get_us());
+
+	if(capture_get_freeze_count() != capture_dumped_count){
+		capture_dumped_count = capture_get_freeze_count();
+		capture_dump_index = 0;
+	}
+
+	while(capture_dump_index >= 0 && console_get_free() >= sizeof(record)){
+		const can_frame_t *p_frame = capture_get_frame(capture_dump_index);
+		capture_window_t window;
+
+		if(p_frame){
+			console_write(record, stream_encode_capture(record, p_frame));
+			capture_dump_index++;
+		}
+		else{
+			/* Re-armed in the middle of the dump, the window is gone */
+			if(capture_get_window(&window) == E_OK){
+				console_write(record, stream_encode_capture_end(record, &window));
+			}
+			capture_dump_index = -1;
+		}
+	}
+}
+
+static void sniffer_stats_main(void){
+	uint8_t record[STREAM_STATS_MAX_LENGTH];
+	uint8_t snapshot[STREAM_SNAPSHOT_MAX_LENGTH];
+
+	can_stats_tick(timebase_get_us());
+
+	while(stats_dump_index >= 0 && console_get_free() >= sizeof(record)){
+		const can_stats_entry_t *p_entry = can_stats_get_entry(stats_dump_index);
+
+		if(p_entry){
+			console_write(record, stream_encode_stats(record, p_entry));
+			stats_dump_index++;
+		}
+		else{
+			console_write(record, stream_encode_stats_summary(record, (uint16_t)stats_dump_index));
+			stats_dump_index = -1;
+		}
+	}
+
+	while(stats_dump_index < 0 && snapshot_dump_index >= 0 && console_get_free() >= sizeof(snapshot)){
+		const can_stats_entry_t *p_entry = can_stats_get_entry(snapshot_dump_index);
+
+		if(p_entry){
+			console_write(snapshot, stream_encode_snapshot(snapshot, p_entry));
+			snapshot_dump_index++;
+		}
+		else{
+			console_write(snapshot, stream_encode_snapshot_end(snapshot, (uint16_t)snapshot_dump_index, timebase_get_us()));
+			snapshot_dump_index = -1;
+		}
+	}
+}
+
+can_frame_t *sniffer_rx_acquire(void){
+	return rx_fifo_acquire_write();
+}
+
+void sniffer_rx_commit(void){
+	rx_fifo_commit_write();
+}
+
+uint32_t sniffer_get_rx_overflow_count(void){
+	return frame_fifo_get_overflow_count(&rx_fifo);
+}
+
+uint32_t sniffer_get_rx_high_water(void){
+	return frame_fifo_get_high_water(&rx_fifo);
+}
+
+static void sniffer_process_frame(const can_frame_t *p_frame){
+	/* Text tag of each can_bus_t, HS keeps the plain tag of single bus builds */
+	static const char * const bus_tags[CAN_BUS_COUNT] = { "RX", "RX-MS", "RX-MM" };
+
+	bool capturing = sniffer_capturing();
+	bool changed = can_stats_update(p_frame, delta_heartbeat_us);
+
+	capture_frame(p_frame);
+
+	if(capturing || (delta_enabled && !changed)){
+		/* Kept for the capture window or repeated payload, nothing to forward */
+	}
+	else if(stream_get_format() == STREAM_FORMAT_BINARY){
+		uint8_t record[STREAM_FRAME_MAX_LENGTH];
+
+		if(console_write(record, stream_encode_frame(record, p_frame))){
+			stream_frame_sent(p_frame);
+		}
+	}
+	else{
+		char line[CAN_FORMAT_LINE_MAX_LENGTH];
+
+		console_write(line, can_format_frame(line, bus_tags[p_frame->bus % CAN_BUS_COUNT], p_frame));
+	}
+
+	// Check Engine Response ID, OBD requests go out on HS bus only
+	if (p_frame->bus == CAN_BUS_HS && p_frame->id == 0x7E8 && !(p_frame->flags & CAN_FRAME_FLAG_IDE)) {
+		obd2_parse_packet((uint8_t *)p_frame->data, GET_SIZE(p_frame->data));
+	}
+}
+
+void sniffer_main(void){
+	const can_frame_t *p_frame;
+
+	/* Leave frames queued while console can't take them, so losses show up
+	 * in the overflow counter instead of silently dropped lines. A capture
+	 * does not wait for console */
+	while(sniffer_capturing() || console_get_free() >= SNIFFER_LINE_MAX_LENGTH){
+		p_frame = rx_fifo_acquire_read();
+		if(p_frame == NULL){
+			break;
+		}
+
+		sniffer_process_frame(p_frame);
+		rx_fifo_commit_read();
+	}
+
+	sniffer_stats_main();
+	sniffer_capture_main();
+
+	uint32_t overflow_count = frame_fifo_get_overflow_count(&rx_fifo);
+	if(overflow_count != reported_overflow_count){
+		reported_overflow_count = overflow_count;
+		console_print("%.8lu RX FIFO overflow! LOST=%lu HWM=%lu\r\n", timebase_get_us(),
+				overflow_count, (uint32_t)frame_fifo_get_high_water(&rx_fifo));
+	}
+}
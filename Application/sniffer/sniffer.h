@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "frame_fifo.h"
+
+void sniffer_init(void);
+void sniffer_main(void);
+void sniffer_dump_stats(void);
+void sniffer_dump_snapshot(void);
+bool sniffer_dump_capture(void);
+void sniffer_set_delta(bool enable, uint32_t heartbeat_ms);
+can_frame_t *sniffer_rx_acquire(void);
+void sniffer_rx_commit(void);
+uint32_t sniffer_get_rx_overflow_count(void);
+uint32_t sniffer_get_rx_high_water(void);
@@ -0,0 +1,432 @@
+/* Includes ================================================================= */
+#include "stream.h"
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+static volatile stream_format_t stream_format = STREAM_FORMAT_TEXT;
+static uint32_t                 last_frame_timestamp;
+
+/* CRC-8, polynomial 0x07. */
+static const uint8_t crc8_table[256] = {
+  0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31,
+  0x24, 0x23, 0x2A, 0x2D, 0x70, 0x77, 0x7E, 0x79, 0x6C, 0x6B, 0x62, 0x65,
+  0x48, 0x4F, 0x46, 0x41, 0x54, 0x53, 0x5A, 0x5D, 0xE0, 0xE7, 0xEE, 0xE9,
+  0xFC, 0xFB, 0xF2, 0xF5, 0xD8, 0xDF, 0xD6, 0xD1, 0xC4, 0xC3, 0xCA, 0xCD,
+  0x90, 0x97, 0x9E, 0x99, 0x8C, 0x8B, 0x82, 0x85, 0xA8, 0xAF, 0xA6, 0xA1,
+  0xB4, 0xB3, 0xBA, 0xBD, 0xC7, 0xC0, 0xC9, 0xCE, 0xDB, 0xDC, 0xD5, 0xD2,
+  0xFF, 0xF8, 0xF1, 0xF6, 0xE3, 0xE4, 0xED, 0xEA, 0xB7, 0xB0, 0xB9, 0xBE,
+  0xAB, 0xAC, 0xA5, 0xA2, 0x8F, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9D, 0x9A,
+  0x27, 0x20, 0x29, 0x2E, 0x3B, 0x3C, 0x35, 0x32, 0x1F, 0x18, 0x11, 0x16,
+  0x03, 0x04, 0x0D, 0x0A, 0x57, 0x50, 0x59, 0x5E, 0x4B, 0x4C, 0x45, 0x42,
+  0x6F, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7D, 0x7A, 0x89, 0x8E, 0x87, 0x80,
+  0x95, 0x92, 0x9B, 0x9C, 0xB1, 0xB6, 0xBF, 0xB8, 0xAD, 0xAA, 0xA3, 0xA4,
+  0xF9, 0xFE, 0xF7, 0xF0, 0xE5, 0xE2, 0xEB, 0xEC, 0xC1, 0xC6, 0xCF, 0xC8,
+  0xDD, 0xDA, 0xD3, 0xD4, 0x69, 0x6E, 0x67, 0x60, 0x75, 0x72, 0x7B, 0x7C,
+  0x51, 0x56, 0x5F, 0x58, 0x4D, 0x4A, 0x43, 0x44, 0x19, 0x1E, 0x17, 0x10,
+  0x05, 0x02, 0x0B, 0x0C, 0x21, 0x26, 0x2F, 0x28, 0x3D, 0x3A, 0x33, 0x34,
+  0x4E, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5C, 0x5B, 0x76, 0x71, 0x78, 0x7F,
+  0x6A, 0x6D, 0x64, 0x63, 0x3E, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2C, 0x2B,
+  0x06, 0x01, 0x08, 0x0F, 0x1A, 0x1D, 0x14, 0x13, 0xAE, 0xA9, 0xA0, 0xA7,
+  0xB2, 0xB5, 0xBC, 0xBB, 0x96, 0x91, 0x98, 0x9F, 0x8A, 0x8D, 0x84, 0x83,
+  0xDE, 0xD9, 0xD0, 0xD7, 0xC2, 0xC5, 0xCC, 0xCB, 0xE6, 0xE1, 0xE8, 0xEF,
+  0xFA, 0xFD, 0xF4, 0xF3
+};
+
+/* Private functions  ======================================================= */
+
+/**
+ * @brief Calculates CRC-8 of the buffer.
+ */
+static uint8_t stream_crc8(const uint8_t * p_data, size_t length)
+{
+  uint8_t crc = 0;
+
+  for (size_t i = 0; i < length; ++i)
+  {
+    crc = crc8_table[crc ^ p_data[i]];
+  }
+
+  return crc;
+}
+
+/**
+ * @brief Appends CRC, COBS encodes the raw record and terminates it with 0x00.
+ *
+ * @param[out] p_dst  Output buffer, at least STREAM_ENCODED_SIZE(length + 1).
+ * @param[in]  p_raw  Raw record, must have one spare byte for the CRC.
+ */
+static size_t stream_cobs_encode(uint8_t * p_dst, uint8_t * p_raw, size_t length)
+{
+  size_t code_pos = 0;
+  size_t out_pos  = 1;
+  uint8_t code    = 1;
+
+  p_raw[length] = stream_crc8(p_raw, length);
+  length++;
+
+  for (size_t i = 0; i < length; ++i)
+  {
+    if (p_raw[i] == 0)
+    {
+      p_dst[code_pos] = code;
+      code_pos        = out_pos++;
+      code            = 1;
+    }
+    else
+    {
+      p_dst[out_pos++] = p_raw[i];
+      code++;
+
+      if (code == 0xFF)
+      {
+        p_dst[code_pos] = code;
+        code_pos        = out_pos++;
+        code            = 1;
+      }
+    }
+  }
+
+  p_dst[code_pos]  = code;
+  p_dst[out_pos++] = 0x00;
+
+  return out_pos;
+}
+
+/**
+ * @brief Appends a little endian value to the raw record.
+ */
+static size_t stream_put_le(uint8_t * p_raw, size_t length, uint32_t value, uint8_t size)
+{
+  for (uint8_t i = 0; i < size; ++i)
+  {
+    p_raw[length++] = (uint8_t)(value >> (8 * i));
+  }
+
+  return length;
+}
+
+/* Shared functions ========================================================= */
+void stream_set_format(stream_format_t format)
+{
+  last_frame_timestamp = 0;
+  stream_format        = format;
+}
+
+stream_format_t stream_get_format(void)
+{
+  return stream_format;
+}
+
+size_t stream_encode_frame(uint8_t * p_dst, const can_frame_t * p_frame)
+{
+  uint8_t  raw[1 + 5 + 1 + 4 + 8 + 1];
+  size_t   length = 0;
+  uint32_t delta  = p_frame->timestamp - last_frame_timestamp;
+  uint8_t  dlc    = (p_frame->dlc > 8) ? 8 : p_frame->dlc;
+
+  raw[length++] = (uint8_t)((STREAM_RECORD_FRAME << 4) | dlc);
+
+  /* LEB128 timestamp delta. */
+  while (delta >= 0x80)
+  {
+    raw[length++] = (uint8_t)(delta | 0x80);
+    delta >>= 7;
+  }
+  raw[length++] = (uint8_t)delta;
+
+  raw[length++] = (uint8_t)((p_frame->flags & (CAN_FRAME_FLAG_IDE | CAN_FRAME_FLAG_RTR)) |
+                            ((p_frame->bus & 0x03) << 2));
+
+  raw[length++] = (uint8_t)(p_frame->id);
+  raw[length++] = (uint8_t)(p_frame->id >> 8);
+  if (p_frame->flags & CAN_FRAME_FLAG_IDE)
+  {
+    raw[length++] = (uint8_t)(p_frame->id >> 16);
+    raw[length++] = (uint8_t)(p_frame->id >> 24);
+  }
+
+  for (uint8_t i = 0; i < dlc; ++i)
+  {
+    raw[length++] = p_frame->data[i];
+  }
+
+  return stream_cobs_encode(p_dst, raw, length);
+}
+
+void stream_frame_sent(const can_frame_t * p_frame)
+{
+  last_frame_timestamp = p_frame->timestamp;
+}
+
+size_t
+stream_encode_text(uint8_t * p_dst, const char * p_text, size_t length)
+{
+  /* Raw record is assembled at the tail of the output buffer and encoded
+   * towards its head. COBS output never overtakes its input, so no separate
+   * scratch buffer is needed. */
+  uint8_t * p_raw = &p_dst[STREAM_ENCODED_SIZE(length + 2) - (length + 2)];
+
+  for (size_t i = length; i > 0; --i)
+  {
+    p_raw[i] = (uint8_t)p_text[i - 1];
+  }
+  p_raw[0] = (uint8_t)(STREAM_RECORD_TEXT << 4);
+
+  return stream_cobs_encode(p_dst, p_raw, length + 1);
+}
+
+size_t stream_encode_event(uint8_t *        p_dst,
+                           uint16_t         id,
+                           uint32_t         timestamp,
+                           const uint32_t * p_args,
+                           uint8_t          arg_count)
+{
+  uint8_t raw[1 + 2 + 4 + (4 * STREAM_EVENT_MAX_ARGS) + 1];
+  size_t  length = 0;
+
+  if (arg_count > STREAM_EVENT_MAX_ARGS)
+  {
+    arg_count = STREAM_EVENT_MAX_ARGS;
+  }
+
+  raw[length++] = (uint8_t)((STREAM_RECORD_EVENT << 4) | arg_count);
+  raw[length++] = (uint8_t)(id);
+  raw[length++] = (uint8_t)(id >> 8);
+  raw[length++] = (uint8_t)(timestamp);
+  raw[length++] = (uint8_t)(timestamp >> 8);
+  raw[length++] = (uint8_t)(timestamp >> 16);
+  raw[length++] = (uint8_t)(timestamp >> 24);
+
+  for (uint8_t i = 0; i < arg_count; ++i)
+  {
+    raw[length++] = (uint8_t)(p_args[i]);
+    raw[length++] = (uint8_t)(p_args[i] >> 8);
+    raw[length++] = (uint8_t)(p_args[i] >> 16);
+    raw[length++] = (uint8_t)(p_args[i] >> 24);
+  }
+
+  return stream_cobs_encode(p_dst, raw, length);
+}
+
+size_t
+stream_encode_stats(uint8_t * p_dst, const can_stats_entry_t * p_entry)
+{
+  uint8_t raw[1 + 4 + 4 + 1 + 1 + 16 + 1];
+  size_t  length = 0;
+  bool    timed  = (p_entry->count >= 2);
+
+  raw[length++] = (uint8_t)(STREAM_RECORD_STATS << 4);
+  length        = stream_put_le(raw, length, p_entry->id, 4);
+  length        = stream_put_le(raw, length, p_entry->count, 4);
+  raw[length++] = p_entry->dlc;
+  raw[length++] = p_entry->bus;
+  length = stream_put_le(raw, length, timed ? p_entry->period_min : 0, 4);
+  length = stream_put_le(raw, length, p_entry->period_avg >> CAN_STATS_AVG_SHIFT, 4);
+  length = stream_put_le(raw, length, p_entry->period_max, 4);
+  length = stream_put_le(raw, length, p_entry->jitter >> CAN_STATS_AVG_SHIFT, 4);
+
+  return stream_cobs_encode(p_dst, raw, length);
+}
+
+size_t stream_encode_stats_summary(uint8_t * p_dst, uint16_t entry_count)
+{
+  uint8_t raw[1 + (2 * CAN_BUS_COUNT) + 2 + 4 + 4 + 1];
+  size_t  length = 0;
+
+  raw[length++] = (uint8_t)((STREAM_RECORD_STATS << 4) | 1);
+  for (uint8_t bus = 0; bus < CAN_BUS_COUNT; ++bus)
+  {
+    length = stream_put_le(raw, length, can_stats_get_bus_load(bus), 2);
+  }
+  length        = stream_put_le(raw, length, entry_count, 2);
+  length        = stream_put_le(raw, length, can_stats_get_frame_count(), 4);
+  length        = stream_put_le(raw, length, can_stats_get_dropped_count(), 4);
+
+  return stream_cobs_encode(p_dst, raw, length);
+}
+
+size_t
+stream_encode_snapshot(uint8_t * p_dst, const can_stats_entry_t * p_entry)
+{
+  uint8_t raw[1 + 4 + 1 + 1 + 1 + 4 + 8 + 1];
+  size_t  length = 0;
+
+  raw[length++] = (uint8_t)(STREAM_RECORD_SNAPSHOT << 4);
+  length        = stream_put_le(raw, length, p_entry->id, 4);
+  raw[length++] = p_entry->flags;
+  raw[length++] = p_entry->bus;
+  raw[length++] = p_entry->dlc;
+  length        = stream_put_le(raw, length, p_entry->last_timestamp, 4);
+
+  for (uint8_t i = 0; i < sizeof(p_entry->data); ++i)
+  {
+    raw[length++] = p_entry->data[i];
+  }
+
+  return stream_cobs_encode(p_dst, raw, length);
+}
+
+size_t stream_encode_snapshot_end(uint8_t * p_dst, uint16_t entry_count, uint32_t timestamp)
+{
+  uint8_t raw[1 + 2 + 4 + 1];
+  size_t  length = 0;
+
+  raw[length++] = (uint8_t)((STREAM_RECORD_SNAPSHOT << 4) | 1);
+  length        = stream_put_le(raw, length, entry_count, 2);
+  length        = stream_put_le(raw, length, timestamp, 4);
+
+  return stream_cobs_encode(p_dst, raw, length);
+}
+
+size_t stream_encode_errors(uint8_t * p_dst, uint8_t bus, const can_errors_bus_t * p_bus)
+{
+  uint8_t raw[1 + 6 + 4 + (4 * (CAN_ERRORS_LEC_COUNT - 1)) + 1];
+  size_t  length = 0;
+
+  raw[length++] = (uint8_t)(STREAM_RECORD_ERRORS << 4);
+  raw[length++] = bus;
+  raw[length++] = p_bus->state;
+  raw[length++] = p_bus->tec;
+  raw[length++] = p_bus->rec;
+  raw[length++] = p_bus->tec_max;
+  raw[length++] = p_bus->rec_max;
+  length        = stream_put_le(raw, length, p_bus->suppressed, 4);
+
+  for (uint8_t lec = CAN_ERRORS_LEC_STUFF; lec < CAN_ERRORS_LEC_COUNT; ++lec)
+  {
+    length = stream_put_le(raw, length, p_bus->lec_count[lec], 4);
+  }
+
+  return stream_cobs_encode(p_dst, raw, length);
+}
+
+size_t stream_encode_capture(uint8_t * p_dst, const can_frame_t * p_frame)
+{
+  uint8_t raw[1 + 4 + 1 + 1 + 4 + 8 + 1];
+  size_t  length = 0;
+  uint8_t dlc    = (p_frame->dlc > 8) ? 8 : p_frame->dlc;
+  bool    ext    = (p_frame->flags & CAN_FRAME_FLAG_IDE) != 0;
+
+  raw[length++] = (uint8_t)(STREAM_RECORD_CAPTURE << 4);
+  length        = stream_put_le(raw, length, p_frame->timestamp, 4);
+  raw[length++] = (uint8_t)((p_frame->flags & (CAN_FRAME_FLAG_IDE | CAN_FRAME_FLAG_RTR)) |
+                            ((p_frame->bus & 0x03) << 2));
+  raw[length++] = dlc;
+  length        = stream_put_le(raw, length, p_frame->id, ext ? 4 : 2);
+
+  for (uint8_t i = 0; i < dlc; ++i)
+  {
+    raw[length++] = p_frame->data[i];
+  }
+
+  return stream_cobs_encode(p_dst, raw, length);
+}
+
+size_t stream_encode_capture_end(uint8_t * p_dst, const capture_window_t * p_window)
+{
+  uint8_t raw[1 + 2 + 2 + 4 + 1 + 1 + 1];
+  size_t  length = 0;
+
+  raw[length++] = (uint8_t)((STREAM_RECORD_CAPTURE << 4) | 1);
+  length        = stream_put_le(raw, length, (uint32_t)p_window->length, 2);
+  length        = stream_put_le(raw, length, (uint32_t)p_window->trigger, 2);
+  length        = stream_put_le(raw, length, p_window->timestamp, 4);
+  raw[length++] = p_window->source;
+  raw[length++] = p_window->bus;
+
+  return stream_cobs_encode(p_dst, raw, length);
+}
+
+size_t stream_encode_replay_report(uint8_t * p_dst, uint32_t sequence, int32_t error)
+{
+  uint8_t raw[1 + 4 + 4 + 1];
+  size_t  length = 0;
+
+  raw[length++] = (uint8_t)(STREAM_RECORD_REPLAY << 4);
+  length        = stream_put_le(raw, length, sequence, 4);
+  length        = stream_put_le(raw, length, (uint32_t)error, 4);
+
+  return stream_cobs_encode(p_dst, raw, length);
+}
+
+size_t stream_decode(uint8_t * p_raw, const uint8_t * p_src, size_t length)
+{
+  size_t in_pos  = 0;
+  size_t out_pos = 0;
+
+  while (in_pos < length)
+  {
+    uint8_t code = p_src[in_pos++];
+
+    if ((code == 0) || ((in_pos + code - 1) > length))
+    {
+      return 0;
+    }
+
+    for (uint8_t i = 1; i < code; ++i)
+    {
+      p_raw[out_pos++] = p_src[in_pos++];
+    }
+
+    /* Every group but a full one and the last implies a zero byte. */
+    if ((code != 0xFF) && (in_pos < length))
+    {
+      p_raw[out_pos++] = 0;
+    }
+  }
+
+  /* Header and CRC at least. */
+  if ((out_pos < 2) || (stream_crc8(p_raw, out_pos - 1) != p_raw[out_pos - 1]))
+  {
+    return 0;
+  }
+
+  return out_pos - 1;
+}
+
+bool stream_decode_replay(const uint8_t * p_raw, size_t length, can_frame_t * p_frame)
+{
+  size_t  pos = 1;
+  uint8_t dlc = p_raw[0] & 0x0F;
+
+  if (((p_raw[0] >> 4) != STREAM_RECORD_REPLAY) || (dlc > 8) || (length < (1 + 4 + 1 + 2)))
+  {
+    return false;
+  }
+
+  p_frame->timestamp = (uint32_t)p_raw[pos] | ((uint32_t)p_raw[pos + 1] << 8) |
+                       ((uint32_t)p_raw[pos + 2] << 16) | ((uint32_t)p_raw[pos + 3] << 24);
+  pos += 4;
+
+  p_frame->flags    = p_raw[pos] & (CAN_FRAME_FLAG_IDE | CAN_FRAME_FLAG_RTR);
+  p_frame->bus      = (p_raw[pos] >> 2) & 0x03;
+  p_frame->dlc      = dlc;
+  p_frame->reserved = 0;
+  pos++;
+
+  size_t id_size      = (p_frame->flags & CAN_FRAME_FLAG_IDE) ? 4 : 2;
+  size_t payload_size = (p_frame->flags & CAN_FRAME_FLAG_RTR) ? 0 : dlc;
+
+  if (length != (pos + id_size + payload_size))
+  {
+    return false;
+  }
+
+  p_frame->id = (uint32_t)p_raw[pos] | ((uint32_t)p_raw[pos + 1] << 8);
+  if (id_size == 4)
+  {
+    p_frame->id |= ((uint32_t)p_raw[pos + 2] << 16) | ((uint32_t)p_raw[pos + 3] << 24);
+  }
+  p_frame->id &= (id_size == 4) ? 0x1FFFFFFFUL : 0x7FFUL;
+  pos += id_size;
+
+  for (uint8_t i = 0; i < payload_size; ++i)
+  {
+    p_frame->data[i] = p_raw[pos + i];
+  }
+
+  return true;
+}
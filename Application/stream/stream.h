@@ -0,0 +1,360 @@
+/** ========================================================================= *
+ *
+ * @brief Binary COBS-framed output stream.
+ *
+ * In binary mode every record sent to the host is COBS encoded and terminated
+ * by a single 0x00 byte, so the host resynchronizes on the next 0x00 after any
+ * loss. Decoded record layout (multi-byte fields are little endian):
+ *
+ *   offset  size  field
+ *   0       1     header: bits 7..4 record type, bits 3..0 type specific
+ *   1       n     record body, see below
+ *   1 + n   1     CRC-8 (poly 0x07, init 0x00) of header and body
+ *
+ * STREAM_RECORD_FRAME (header low nibble = DLC):
+ *   varint  timestamp delta (us) to the previous frame record, LEB128 (7 bits
+ *           per byte, LSB group first, bit 7 set if more bytes follow)
+ *   1       flags: bit 0 IDE, bit 1 RTR, bits 3..2 source bus
+ *   2 or 4  identifier, 4 bytes if IDE is set
+ *   DLC     payload
+ *
+ * STREAM_RECORD_TEXT (header low nibble = 0):
+ *   n       console text (not NUL-terminated)
+ *
+ * STREAM_RECORD_EVENT (header low nibble = amount of arguments):
+ *   2       event ID, see event_log_id_t
+ *   4       absolute timestamp in microseconds
+ *   4 * n   raw 32-bit arguments, formatted by the host
+ *
+ * STREAM_RECORD_STATS (header low nibble 0 = ID entry):
+ *   4       identifier, bit 31 set for extended IDs
+ *   4       frame count
+ *   1       DLC of the last frame
+ *   1       source bus
+ *   4       min inter-arrival time (us), 0 until two frames were seen
+ *   4       average inter-arrival time (us)
+ *   4       max inter-arrival time (us)
+ *   4       jitter, averaged deviation from the average (us)
+ *
+ * STREAM_RECORD_STATS (header low nibble 1 = summary, ends a table dump):
+ *   2 * 3   bus load in 0.1 % of the HS, MS and MM bus
+ *   2       amount of entries dumped
+ *   4       frames accounted
+ *   4       frames whose ID did not fit the table
+ *
+ * STREAM_RECORD_SNAPSHOT (header low nibble 0 = ID entry):
+ *   4       identifier, bit 31 set for extended IDs
+ *   1       flags of the last frame: bit 0 IDE, bit 1 RTR
+ *   1       source bus
+ *   1       DLC of the last frame
+ *   4       absolute timestamp of the last frame (us)
+ *   8       payload of the last frame, bytes past the DLC are undefined
+ *
+ * STREAM_RECORD_SNAPSHOT (header low nibble 1 = end, ends a snapshot dump):
+ *   2       amount of entries dumped
+ *   4       absolute timestamp of the end of the dump (us)
+ *
+ * STREAM_RECORD_ERRORS (header low nibble 0 = bus summary, rate limited):
+ *   1       bus
+ *   1       error state: 0 active, 1 warning, 2 passive, 3 bus-off
+ *   1       transmit error counter
+ *   1       receive error counter
+ *   1       highest transmit error counter of the period
+ *   1       highest receive error counter of the period
+ *   4       state transitions not reported as events
+ *   4 * 6   errors since reset: stuff, form, ACK, bit 1, bit 0, CRC
+ *
+ * STREAM_RECORD_REPLAY (header low nibble 0 = frame report, device to host):
+ *   4       position of the frame among the well formed frame records of
+ *           the trace, frames skipped for their bus or for listen-only
+ *           mode get no report
+ *   4       scheduling error (us, signed), time the frame was handed to the
+ *           TX queue minus its due time
+ *
+ * STREAM_RECORD_REPLAY (host to device, header low nibble = DLC):
+ *   4       trace timestamp (us), only differences to the first frame count
+ *   1       flags: bit 0 IDE, bit 1 RTR, bits 3..2 target bus, the MS bus
+ *           goes out on CAN1, HS and MM on CAN2 if it is routed to that bus,
+ *           otherwise the frame is skipped, as is every frame due while
+ *           listen-only mode is on
+ *   2 or 4  identifier, 4 bytes if IDE is set
+ *   DLC     payload, omitted for remote frames
+ *
+ * STREAM_RECORD_REPLAY (host to device, header low nibble 0xF = end of
+ * trace, no body).
+ *
+ * STREAM_RECORD_CAPTURE (header low nibble 0 = frame of a captured window):
+ *   4       absolute timestamp (us)
+ *   1       flags: bit 0 IDE, bit 1 RTR, bits 3..2 source bus
+ *   1       DLC
+ *   2 or 4  identifier, 4 bytes if IDE is set
+ *   DLC     payload
+ *
+ * STREAM_RECORD_CAPTURE (header low nibble 1 = end, ends a window dump):
+ *   2       amount of frames dumped
+ *   2       trigger position, index of the first frame at or after the
+ *           trigger, equal to the amount of frames if there was none
+ *   4       absolute timestamp of the trigger (us), 0 if none
+ *   1       trigger condition that matched, 0xFF if none
+ *   1       bus of the trigger frame or error
+ *
+ * The first frame record after switching to binary mode carries the absolute
+ * timestamp as its delta. A standard 8-byte frame costs 17 bytes on the wire
+ * while frames are 128 us to 16 ms apart (16 below, 18 up to 2 s).
+ *
+ *  ========================================================================= */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "frame_fifo.h"
+#include "can_stats.h"
+#include "can_errors.h"
+#include "capture.h"
+
+/* Macros =================================================================== */
+
+/** COBS encoded size (incl. delimiter) of a record with raw_size bytes. */
+#define STREAM_ENCODED_SIZE(raw_size) ((raw_size) + ((raw_size) / 254) + 2)
+
+/** Longest encoded frame record. */
+#define STREAM_FRAME_MAX_LENGTH STREAM_ENCODED_SIZE(1 + 5 + 1 + 4 + 8 + 1)
+
+/** Most arguments carried by an event record. */
+#define STREAM_EVENT_MAX_ARGS (2)
+
+/** Longest encoded event record. */
+#define STREAM_EVENT_MAX_LENGTH \
+  STREAM_ENCODED_SIZE(1 + 2 + 4 + (4 * STREAM_EVENT_MAX_ARGS) + 1)
+
+/** Longest encoded statistics record. */
+#define STREAM_STATS_MAX_LENGTH STREAM_ENCODED_SIZE(1 + 4 + 4 + 1 + 1 + 16 + 1)
+
+/** Longest encoded snapshot record. */
+#define STREAM_SNAPSHOT_MAX_LENGTH STREAM_ENCODED_SIZE(1 + 4 + 1 + 1 + 1 + 4 + 8 + 1)
+
+/** Longest encoded error telemetry record. */
+#define STREAM_ERRORS_MAX_LENGTH \
+  STREAM_ENCODED_SIZE(1 + 6 + 4 + (4 * (CAN_ERRORS_LEC_COUNT - 1)) + 1)
+
+/** Longest encoded replay record sent by the host. */
+#define STREAM_REPLAY_MAX_LENGTH STREAM_ENCODED_SIZE(1 + 4 + 1 + 4 + 8 + 1)
+
+/** Longest encoded replay frame report. */
+#define STREAM_REPLAY_REPORT_MAX_LENGTH STREAM_ENCODED_SIZE(1 + 4 + 4 + 1)
+
+/** Longest encoded capture record. */
+#define STREAM_CAPTURE_MAX_LENGTH STREAM_ENCODED_SIZE(1 + 4 + 1 + 1 + 4 + 8 + 1)
+
+/** Header low nibble of the replay record which ends a trace. */
+#define STREAM_REPLAY_END (0xF)
+
+/* Enums ==================================================================== */
+typedef enum {
+	STREAM_FORMAT_TEXT = 0,
+	STREAM_FORMAT_BINARY
+} stream_format_t;
+
+typedef enum {
+	STREAM_RECORD_FRAME    = 0x1,
+	STREAM_RECORD_TEXT     = 0x2,
+	STREAM_RECORD_EVENT    = 0x3,
+	STREAM_RECORD_STATS    = 0x4,
+	STREAM_RECORD_SNAPSHOT = 0x5,
+	STREAM_RECORD_ERRORS   = 0x6,
+	STREAM_RECORD_REPLAY   = 0x7,
+	STREAM_RECORD_CAPTURE  = 0x8
+} stream_record_t;
+
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+
+/**
+ * @brief Selects the output format, resets the frame timestamp reference.
+ *
+ * @param[in]  format   New output format.
+ */
+void stream_set_format(stream_format_t format);
+
+/**
+ * @brief Returns the currently selected output format.
+ *
+ * @return  Output format.
+ */
+stream_format_t stream_get_format(void);
+
+/**
+ * @brief Encodes a frame record.
+ *
+ * The timestamp delta is taken against the previous frame passed to
+ * stream_frame_sent(), so the reference only moves on frames that really
+ * reached the host.
+ *
+ * @param[out] p_dst    Output buffer, at least STREAM_FRAME_MAX_LENGTH long.
+ * @param[in]  p_frame  Frame to encode.
+ *
+ * @return  Encoded length in bytes, including the 0x00 delimiter.
+ */
+size_t stream_encode_frame(uint8_t * p_dst, const can_frame_t * p_frame);
+
+/**
+ * @brief Moves the timestamp reference to the frame which has been sent.
+ *
+ * @param[in]  p_frame  Frame that was encoded and queued for the host.
+ */
+void stream_frame_sent(const can_frame_t * p_frame);
+
+/**
+ * @brief Encodes a text record.
+ *
+ * @param[out] p_dst    Output buffer, at least STREAM_ENCODED_SIZE(length + 2)
+ *                      bytes long.
+ * @param[in]  p_text   Text to encode.
+ * @param[in]  length   Length of the text.
+ *
+ * @return  Encoded length in bytes, including the 0x00 delimiter.
+ */
+size_t
+stream_encode_text(uint8_t * p_dst, const char * p_text, size_t length);
+
+/**
+ * @brief Encodes an event record.
+ *
+ * @param[out] p_dst      Output buffer, at least STREAM_EVENT_MAX_LENGTH long.
+ * @param[in]  id         Event ID.
+ * @param[in]  timestamp  Time the event occurred at.
+ * @param[in]  p_args     Raw event arguments.
+ * @param[in]  arg_count  Amount of arguments, up to STREAM_EVENT_MAX_ARGS.
+ *
+ * @return  Encoded length in bytes, including the 0x00 delimiter.
+ */
+size_t stream_encode_event(uint8_t *        p_dst,
+                           uint16_t         id,
+                           uint32_t         timestamp,
+                           const uint32_t * p_args,
+                           uint8_t          arg_count);
+
+/**
+ * @brief Encodes a statistics record of one identifier.
+ *
+ * @param[out] p_dst    Output buffer, at least STREAM_STATS_MAX_LENGTH long.
+ * @param[in]  p_entry  Statistics entry.
+ *
+ * @return  Encoded length in bytes, including the 0x00 delimiter.
+ */
+size_t
+stream_encode_stats(uint8_t * p_dst, const can_stats_entry_t * p_entry);
+
+/**
+ * @brief Encodes the statistics summary record which ends a table dump.
+ *
+ * @param[out] p_dst        Output buffer, at least STREAM_STATS_MAX_LENGTH.
+ * @param[in]  entry_count  Amount of entry records sent before.
+ *
+ * @return  Encoded length in bytes, including the 0x00 delimiter.
+ */
+size_t stream_encode_stats_summary(uint8_t * p_dst, uint16_t entry_count);
+
+/**
+ * @brief Encodes the latest payload of one identifier.
+ *
+ * @param[out] p_dst    Output buffer, at least STREAM_SNAPSHOT_MAX_LENGTH.
+ * @param[in]  p_entry  Statistics entry holding the payload.
+ *
+ * @return  Encoded length in bytes, including the 0x00 delimiter.
+ */
+size_t
+stream_encode_snapshot(uint8_t * p_dst, const can_stats_entry_t * p_entry);
+
+/**
+ * @brief Encodes the record which ends a snapshot dump.
+ *
+ * @param[out] p_dst        Output buffer, at least STREAM_SNAPSHOT_MAX_LENGTH.
+ * @param[in]  entry_count  Amount of entry records sent before.
+ * @param[in]  timestamp    Current time in microseconds.
+ *
+ * @return  Encoded length in bytes, including the 0x00 delimiter.
+ */
+size_t stream_encode_snapshot_end(uint8_t * p_dst, uint16_t entry_count, uint32_t timestamp);
+
+/**
+ * @brief Encodes the error telemetry summary of one bus.
+ *
+ * @param[out] p_dst  Output buffer, at least STREAM_ERRORS_MAX_LENGTH long.
+ * @param[in]  bus    Bus, see can_bus_t.
+ * @param[in]  p_bus  Telemetry of the bus.
+ *
+ * @return  Encoded length in bytes, including the 0x00 delimiter.
+ */
+size_t stream_encode_errors(uint8_t * p_dst, uint8_t bus, const can_errors_bus_t * p_bus);
+
+/**
+ * @brief Encodes a frame of a captured window.
+ *
+ * @param[out] p_dst    Output buffer, at least STREAM_CAPTURE_MAX_LENGTH long.
+ * @param[in]  p_frame  Captured frame.
+ *
+ * @return  Encoded length in bytes, including the 0x00 delimiter.
+ */
+size_t stream_encode_capture(uint8_t * p_dst, const can_frame_t * p_frame);
+
+/**
+ * @brief Encodes the record which ends a window dump.
+ *
+ * @param[out] p_dst     Output buffer, at least STREAM_CAPTURE_MAX_LENGTH.
+ * @param[in]  p_window  Description of the dumped window.
+ *
+ * @return  Encoded length in bytes, including the 0x00 delimiter.
+ */
+size_t stream_encode_capture_end(uint8_t * p_dst, const capture_window_t * p_window);
+
+/**
+ * @brief Encodes the scheduling report of one replayed frame.
+ *
+ * @param[out] p_dst     Output buffer, at least STREAM_REPLAY_REPORT_MAX_LENGTH.
+ * @param[in]  sequence  Sequence number of the frame.
+ * @param[in]  error     Scheduling error in microseconds.
+ *
+ * @return  Encoded length in bytes, including the 0x00 delimiter.
+ */
+size_t stream_encode_replay_report(uint8_t * p_dst, uint32_t sequence, int32_t error);
+
+/**
+ * @brief Decodes a record received from the host.
+ *
+ * @param[out] p_raw    Decoded record, at least length bytes long.
+ * @param[in]  p_src    COBS encoded record without the 0x00 delimiter.
+ * @param[in]  length   Length of the encoded record.
+ *
+ * @return  Length of the decoded record without its CRC, 0 if the record is
+ *          malformed or the CRC does not match.
+ */
+size_t stream_decode(uint8_t * p_raw, const uint8_t * p_src, size_t length);
+
+/**
+ * @brief Parses a decoded replay frame record.
+ *
+ * The trace timestamp is stored in p_frame->timestamp.
+ *
+ * @param[in]  p_raw    Decoded record, see stream_decode().
+ * @param[in]  length   Length of the decoded record.
+ * @param[out] p_frame  Frame to transmit.
+ *
+ * @return  True if the record is a well formed replay frame record.
+ */
+bool stream_decode_replay(const uint8_t * p_raw, size_t length, can_frame_t * p_frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
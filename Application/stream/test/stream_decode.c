@@ -0,0 +1,76 @@
+/** ========================================================================= *
+ *
+ * @brief Decodes a binary stream captured from the device.
+ *
+ * Reads the COBS-framed stream from stdin, checks the CRC of every record and
+ * prints one line per record to stdout. Corrupt records are reported and
+ * skipped, decoding resumes after the next 0x00.
+ *
+ * Usage: stream_decode < capture.bin
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "stream.h"
+#include "stream_print.h"
+
+/* Defines ================================================================== */
+
+/** Longest encoded record accepted, text records are the longest. */
+#define RECORD_MAX_LENGTH (4096)
+
+/* Shared functions ========================================================= */
+int main(void)
+{
+  static uint8_t src[RECORD_MAX_LENGTH];
+  static uint8_t raw[RECORD_MAX_LENGTH];
+  size_t         length     = 0;
+  bool           overlong   = false;
+  uint32_t       frame_time = 0;
+  unsigned long  bad_count  = 0;
+  int            byte;
+
+  while ((byte = getchar()) != EOF)
+  {
+    if (byte != 0)
+    {
+      if (length < sizeof(src))
+      {
+        src[length++] = (uint8_t)byte;
+      }
+      else
+      {
+        overlong = true;
+      }
+      continue;
+    }
+
+    size_t raw_length = overlong ? 0 : stream_decode(raw, src, length);
+
+    if (raw_length != 0)
+    {
+      if (!stream_print_record(stdout, raw, raw_length, &frame_time))
+      {
+        bad_count++;
+      }
+    }
+    else if (length != 0)
+    {
+      printf("CORRUPT length=%lu\n", (unsigned long)length);
+      bad_count++;
+    }
+
+    length   = 0;
+    overlong = false;
+  }
+
+  if (length != 0)
+  {
+    printf("TRUNCATED length=%lu\n", (unsigned long)length);
+  }
+
+  return (bad_count != 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
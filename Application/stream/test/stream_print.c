@@ -0,0 +1,370 @@
+/* Includes ================================================================= */
+#include "stream_print.h"
+#include "stream.h"
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+static const char * const error_states[] = { "ACTIVE", "WARNING", "PASSIVE", "BUSOFF" };
+
+/* Private functions  ======================================================= */
+
+/**
+ * @brief Reads a little endian value of the record.
+ */
+static uint32_t stream_print_le(const uint8_t * p_raw, size_t * p_pos, uint8_t size)
+{
+  uint32_t value = 0;
+
+  for (uint8_t i = 0; i < size; ++i)
+  {
+    value |= (uint32_t)p_raw[(*p_pos)++] << (8 * i);
+  }
+
+  return value;
+}
+
+/**
+ * @brief Prints identifier, flags and payload shared by frame-like records.
+ */
+static void stream_print_frame(FILE *          p_out,
+                               uint8_t         flags,
+                               uint32_t        id,
+                               uint8_t         dlc,
+                               const uint8_t * p_data)
+{
+  if (flags & CAN_FRAME_FLAG_IDE)
+  {
+    fprintf(p_out, " bus=%u id=%08lX EXT", (flags >> 2) & 0x03, (unsigned long)id);
+  }
+  else
+  {
+    fprintf(p_out, " bus=%u id=%03lX", (flags >> 2) & 0x03, (unsigned long)id);
+  }
+  if (flags & CAN_FRAME_FLAG_RTR)
+  {
+    fprintf(p_out, " RTR");
+  }
+
+  fprintf(p_out, " dlc=%u", dlc);
+  for (uint8_t i = 0; (p_data != NULL) && (i < dlc); ++i)
+  {
+    fprintf(p_out, " %02X", p_data[i]);
+  }
+  fprintf(p_out, "\n");
+}
+
+static bool stream_print_frame_record(FILE *          p_out,
+                                      const uint8_t * p_raw,
+                                      size_t          length,
+                                      uint32_t *      p_frame_time)
+{
+  uint8_t  dlc   = p_raw[0] & 0x0F;
+  uint32_t delta = 0;
+  size_t   pos   = 1;
+  uint8_t  shift = 0;
+  uint8_t  flags;
+  size_t   id_size;
+
+  /* LEB128 timestamp delta, at most 5 groups for 32 bits. */
+  do
+  {
+    if ((pos >= length) || (shift > 28))
+    {
+      return false;
+    }
+    delta |= (uint32_t)(p_raw[pos] & 0x7F) << shift;
+    shift += 7;
+  } while (p_raw[pos++] & 0x80);
+
+  if ((dlc > 8) || (pos >= length))
+  {
+    return false;
+  }
+
+  flags   = p_raw[pos++];
+  id_size = (flags & CAN_FRAME_FLAG_IDE) ? 4 : 2;
+  if (length != (pos + id_size + dlc))
+  {
+    return false;
+  }
+
+  *p_frame_time += delta;
+  fprintf(p_out, "FRAME t=%lu dt=%lu", (unsigned long)*p_frame_time, (unsigned long)delta);
+  uint32_t id = stream_print_le(p_raw, &pos, (uint8_t)id_size);
+  stream_print_frame(p_out, flags, id, dlc, &p_raw[pos]);
+
+  return true;
+}
+
+static bool stream_print_text(FILE * p_out, const uint8_t * p_raw, size_t length)
+{
+  fprintf(p_out, "TEXT \"");
+  for (size_t i = 1; i < length; ++i)
+  {
+    switch (p_raw[i])
+    {
+      case '\r': fprintf(p_out, "\\r"); break;
+      case '\n': fprintf(p_out, "\\n"); break;
+      case '"':  fprintf(p_out, "\\\""); break;
+      case '\\': fprintf(p_out, "\\\\"); break;
+      default:
+        if ((p_raw[i] < 0x20) || (p_raw[i] > 0x7E))
+        {
+          fprintf(p_out, "\\x%02X", p_raw[i]);
+        }
+        else
+        {
+          fputc(p_raw[i], p_out);
+        }
+        break;
+    }
+  }
+  fprintf(p_out, "\"\n");
+
+  return true;
+}
+
+static bool stream_print_event(FILE * p_out, const uint8_t * p_raw, size_t length)
+{
+  uint8_t arg_count = p_raw[0] & 0x0F;
+  size_t  pos       = 1;
+
+  if ((arg_count > STREAM_EVENT_MAX_ARGS) || (length != (1 + 2 + 4 + (4 * (size_t)arg_count))))
+  {
+    return false;
+  }
+
+  uint32_t id        = stream_print_le(p_raw, &pos, 2);
+  uint32_t timestamp = stream_print_le(p_raw, &pos, 4);
+
+  fprintf(p_out, "EVENT t=%lu id=%lu", (unsigned long)timestamp, (unsigned long)id);
+  for (uint8_t i = 0; i < arg_count; ++i)
+  {
+    fprintf(p_out, " %lu", (unsigned long)stream_print_le(p_raw, &pos, 4));
+  }
+  fprintf(p_out, "\n");
+
+  return true;
+}
+
+static bool stream_print_stats(FILE * p_out, const uint8_t * p_raw, size_t length)
+{
+  size_t pos = 1;
+
+  if (((p_raw[0] & 0x0F) == 0) && (length == (1 + 4 + 4 + 1 + 1 + 16)))
+  {
+    uint32_t id    = stream_print_le(p_raw, &pos, 4);
+    uint32_t count = stream_print_le(p_raw, &pos, 4);
+    uint8_t  dlc   = p_raw[pos++];
+    uint8_t  bus   = p_raw[pos++];
+    uint32_t min   = stream_print_le(p_raw, &pos, 4);
+    uint32_t avg   = stream_print_le(p_raw, &pos, 4);
+    uint32_t max   = stream_print_le(p_raw, &pos, 4);
+
+    fprintf(p_out,
+            "STATS id=%08lX count=%lu dlc=%u bus=%u min=%lu avg=%lu max=%lu jitter=%lu\n",
+            (unsigned long)id, (unsigned long)count, dlc, bus, (unsigned long)min,
+            (unsigned long)avg, (unsigned long)max,
+            (unsigned long)stream_print_le(p_raw, &pos, 4));
+    return true;
+  }
+
+  if (((p_raw[0] & 0x0F) == 1) && (length == (1 + (2 * CAN_BUS_COUNT) + 2 + 4 + 4)))
+  {
+    fprintf(p_out, "STATS END load=");
+    for (uint8_t bus = 0; bus < CAN_BUS_COUNT; ++bus)
+    {
+      uint32_t load = stream_print_le(p_raw, &pos, 2);
+
+      fprintf(p_out, "%s%lu.%lu", bus ? "/" : "", (unsigned long)(load / 10),
+              (unsigned long)(load % 10));
+    }
+
+    uint32_t entries = stream_print_le(p_raw, &pos, 2);
+    uint32_t frames  = stream_print_le(p_raw, &pos, 4);
+
+    fprintf(p_out, " entries=%lu frames=%lu dropped=%lu\n", (unsigned long)entries,
+            (unsigned long)frames, (unsigned long)stream_print_le(p_raw, &pos, 4));
+    return true;
+  }
+
+  return false;
+}
+
+static bool stream_print_snapshot(FILE * p_out, const uint8_t * p_raw, size_t length)
+{
+  size_t pos = 1;
+
+  if (((p_raw[0] & 0x0F) == 0) && (length == (1 + 4 + 1 + 1 + 1 + 4 + 8)))
+  {
+    uint32_t id    = stream_print_le(p_raw, &pos, 4);
+    uint8_t  flags = p_raw[pos++];
+    uint8_t  bus   = p_raw[pos++];
+    uint8_t  dlc   = p_raw[pos++];
+
+    fprintf(p_out, "SNAPSHOT t=%lu", (unsigned long)stream_print_le(p_raw, &pos, 4));
+    stream_print_frame(p_out, (uint8_t)((flags & 0x03) | ((bus & 0x03) << 2)),
+                       id & ~CAN_STATS_ID_EXT, (dlc > 8) ? 8 : dlc, &p_raw[pos]);
+    return true;
+  }
+
+  if (((p_raw[0] & 0x0F) == 1) && (length == (1 + 2 + 4)))
+  {
+    uint32_t entries = stream_print_le(p_raw, &pos, 2);
+
+    fprintf(p_out, "SNAPSHOT END entries=%lu t=%lu\n", (unsigned long)entries,
+            (unsigned long)stream_print_le(p_raw, &pos, 4));
+    return true;
+  }
+
+  return false;
+}
+
+static bool stream_print_errors(FILE * p_out, const uint8_t * p_raw, size_t length)
+{
+  static const char * const lec_names[] = { "STUFF", "FORM", "ACK", "BIT1", "BIT0", "CRC" };
+  size_t                    pos         = 1;
+
+  if (((p_raw[0] & 0x0F) != 0) || (length != (1 + 6 + 4 + (4 * 6))) || (p_raw[2] > 3))
+  {
+    return false;
+  }
+
+  fprintf(p_out, "ERRORS bus=%u state=%s tec=%u rec=%u tec_max=%u rec_max=%u", p_raw[1],
+          error_states[p_raw[2]], p_raw[3], p_raw[4], p_raw[5], p_raw[6]);
+  pos = 7;
+  fprintf(p_out, " suppressed=%lu", (unsigned long)stream_print_le(p_raw, &pos, 4));
+  for (uint8_t i = 0; i < 6; ++i)
+  {
+    fprintf(p_out, " %s=%lu", lec_names[i], (unsigned long)stream_print_le(p_raw, &pos, 4));
+  }
+  fprintf(p_out, "\n");
+
+  return true;
+}
+
+static bool stream_print_replay(FILE * p_out, const uint8_t * p_raw, size_t length)
+{
+  can_frame_t frame;
+  size_t      pos = 1;
+
+  /* A report and a host frame record share the nibble 0, told by length. */
+  if (((p_raw[0] & 0x0F) == 0) && (length == (1 + 4 + 4)))
+  {
+    uint32_t sequence = stream_print_le(p_raw, &pos, 4);
+
+    fprintf(p_out, "REPLAY REPORT seq=%lu err=%ld\n", (unsigned long)sequence,
+            (long)(int32_t)stream_print_le(p_raw, &pos, 4));
+    return true;
+  }
+
+  if (((p_raw[0] & 0x0F) == STREAM_REPLAY_END) && (length == 1))
+  {
+    fprintf(p_out, "REPLAY END\n");
+    return true;
+  }
+
+  if (stream_decode_replay(p_raw, length, &frame))
+  {
+    fprintf(p_out, "REPLAY t=%lu", (unsigned long)frame.timestamp);
+    stream_print_frame(p_out, (uint8_t)(frame.flags | (frame.bus << 2)), frame.id, frame.dlc,
+                       (frame.flags & CAN_FRAME_FLAG_RTR) ? NULL : frame.data);
+    return true;
+  }
+
+  return false;
+}
+
+static bool stream_print_capture(FILE * p_out, const uint8_t * p_raw, size_t length)
+{
+  size_t pos = 1;
+
+  if (((p_raw[0] & 0x0F) == 0) && (length >= (1 + 4 + 1 + 1 + 2)))
+  {
+    uint32_t timestamp = stream_print_le(p_raw, &pos, 4);
+    uint8_t  flags     = p_raw[pos++];
+    uint8_t  dlc       = p_raw[pos++];
+    uint8_t  id_size   = (flags & CAN_FRAME_FLAG_IDE) ? 4 : 2;
+
+    if ((dlc > 8) || (length != (pos + id_size + dlc)))
+    {
+      return false;
+    }
+
+    fprintf(p_out, "CAPTURE t=%lu", (unsigned long)timestamp);
+    uint32_t id = stream_print_le(p_raw, &pos, id_size);
+    stream_print_frame(p_out, flags, id, dlc, &p_raw[pos]);
+    return true;
+  }
+
+  if (((p_raw[0] & 0x0F) == 1) && (length == (1 + 2 + 2 + 4 + 1 + 1)))
+  {
+    uint32_t frames    = stream_print_le(p_raw, &pos, 2);
+    uint32_t trigger   = stream_print_le(p_raw, &pos, 2);
+    uint32_t timestamp = stream_print_le(p_raw, &pos, 4);
+
+    fprintf(p_out, "CAPTURE END frames=%lu trigger=%lu t=%lu source=%u bus=%u\n",
+            (unsigned long)frames, (unsigned long)trigger, (unsigned long)timestamp,
+            p_raw[pos], p_raw[pos + 1]);
+    return true;
+  }
+
+  return false;
+}
+
+/* Shared functions ========================================================= */
+bool stream_print_record(FILE *          p_out,
+                         const uint8_t * p_raw,
+                         size_t          length,
+                         uint32_t *      p_frame_time)
+{
+  bool valid = false;
+
+  switch (p_raw[0] >> 4)
+  {
+    case STREAM_RECORD_FRAME:
+      valid = stream_print_frame_record(p_out, p_raw, length, p_frame_time);
+      break;
+
+    case STREAM_RECORD_TEXT:
+      valid = stream_print_text(p_out, p_raw, length);
+      break;
+
+    case STREAM_RECORD_EVENT:
+      valid = stream_print_event(p_out, p_raw, length);
+      break;
+
+    case STREAM_RECORD_STATS:
+      valid = stream_print_stats(p_out, p_raw, length);
+      break;
+
+    case STREAM_RECORD_SNAPSHOT:
+      valid = stream_print_snapshot(p_out, p_raw, length);
+      break;
+
+    case STREAM_RECORD_ERRORS:
+      valid = stream_print_errors(p_out, p_raw, length);
+      break;
+
+    case STREAM_RECORD_REPLAY:
+      valid = stream_print_replay(p_out, p_raw, length);
+      break;
+
+    case STREAM_RECORD_CAPTURE:
+      valid = stream_print_capture(p_out, p_raw, length);
+      break;
+
+    default:
+      break;
+  }
+
+  if (!valid)
+  {
+    fprintf(p_out, "BAD type=%X length=%lu\n", p_raw[0] >> 4, (unsigned long)length);
+  }
+
+  return valid;
+}
@@ -0,0 +1,46 @@
+/** ========================================================================= *
+ *
+ * @brief Host side formatter of decoded stream records.
+ *
+ * Prints one line per record, see stream.h for the record layout. Shared by
+ * the stream_decode tool and the round trip test.
+ *
+ *  ========================================================================= */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+
+/**
+ * @brief Prints a decoded record.
+ *
+ * @param[in]     p_out         Output stream.
+ * @param[in]     p_raw         Decoded record without CRC, see stream_decode().
+ * @param[in]     length        Length of the decoded record.
+ * @param[in,out] p_frame_time  Absolute time of the previous frame record,
+ *                              advanced by the delta of a frame record.
+ *
+ * @return  True if the record is well formed, otherwise a BAD line is printed.
+ */
+bool stream_print_record(FILE *          p_out,
+                         const uint8_t * p_raw,
+                         size_t          length,
+                         uint32_t *      p_frame_time);
+
+#ifdef __cplusplus
+}
+#endif
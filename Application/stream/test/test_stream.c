@@ -0,0 +1,341 @@
+/** ========================================================================= *
+ *
+ * @brief Host round trip test of the binary stream.
+ *
+ * Encodes frame, text, event, statistics and the other records with the
+ * device encoders, decodes them with stream_decode() and the host formatter
+ * and compares the result with the values that were encoded.
+ *
+ * Usage: test_stream [seed]
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stream.h"
+#include "stream_print.h"
+
+/* Defines ================================================================== */
+#define RANDOM_FRAMES (100000)
+#define LINE_SIZE     (2048)
+
+/* Macros =================================================================== */
+#define CHECK(__cond)                                                         \
+  do                                                                          \
+  {                                                                           \
+    if (!(__cond))                                                            \
+    {                                                                         \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #__cond);       \
+      failures++;                                                             \
+    }                                                                         \
+  } while (0)
+
+/* Variables ================================================================ */
+static unsigned int failures;
+static uint32_t     random_state = 1;
+static uint32_t     frame_time;
+
+/* Private functions  ======================================================= */
+
+static uint32_t random_next(void)
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+/**
+ * @brief Decodes one encoded record and prints it to p_line.
+ *
+ * @return  False if the delimiter, COBS framing or CRC is wrong.
+ */
+static bool decode(char * p_line, const uint8_t * p_src, size_t length)
+{
+  uint8_t raw[LINE_SIZE];
+  FILE *  p_out;
+  size_t  raw_length;
+  bool    valid;
+
+  p_line[0] = '\0';
+
+  /* Exactly one delimiter, at the end. */
+  if ((length == 0) || (p_src[length - 1] != 0) || (memchr(p_src, 0, length - 1) != NULL))
+  {
+    return false;
+  }
+
+  raw_length = stream_decode(raw, p_src, length - 1);
+  if (raw_length == 0)
+  {
+    return false;
+  }
+
+  p_out = fmemopen(p_line, LINE_SIZE, "w");
+  valid = stream_print_record(p_out, raw, raw_length, &frame_time);
+  fclose(p_out);
+
+  return valid;
+}
+
+static void check_line(const uint8_t * p_src, size_t length, const char * p_expected)
+{
+  char line[LINE_SIZE];
+
+  CHECK(decode(line, p_src, length));
+  if (strcmp(line, p_expected) != 0)
+  {
+    printf("expected: %sdecoded:  %s", p_expected, line);
+    failures++;
+  }
+}
+
+static void test_frames(void)
+{
+  uint8_t     dst[STREAM_FRAME_MAX_LENGTH];
+  char        expected[LINE_SIZE];
+  can_frame_t frame;
+  uint32_t    timestamp = 0;
+
+  stream_set_format(STREAM_FORMAT_BINARY);
+  frame_time = 0;
+
+  for (uint32_t n = 0; n < RANDOM_FRAMES; ++n)
+  {
+    bool   ext = random_next() & 1;
+    size_t pos;
+
+    /* Deltas of every LEB128 length, wrapping the 32-bit timestamp. */
+    uint32_t delta = random_next() >> (random_next() % 32);
+
+    timestamp      += delta;
+    frame.timestamp = timestamp;
+    frame.flags     = (uint8_t)((ext ? CAN_FRAME_FLAG_IDE : 0) |
+                                ((random_next() % 8) ? 0 : CAN_FRAME_FLAG_RTR));
+    frame.id        = ext ? (random_next() & 0x1FFFFFFF) : (random_next() & 0x7FF);
+    frame.dlc       = (uint8_t)(random_next() % 9);
+    frame.bus       = (uint8_t)(random_next() % CAN_BUS_COUNT);
+    for (uint8_t i = 0; i < 8; ++i)
+    {
+      frame.data[i] = (uint8_t)((random_next() % 4) ? random_next() : 0);
+    }
+
+    size_t length = stream_encode_frame(dst, &frame);
+    CHECK(length <= STREAM_FRAME_MAX_LENGTH);
+    stream_frame_sent(&frame);
+
+    pos = (size_t)snprintf(expected, sizeof(expected), "FRAME t=%lu dt=%lu bus=%u",
+                           (unsigned long)timestamp, (unsigned long)delta, frame.bus);
+    pos += (size_t)snprintf(&expected[pos], sizeof(expected) - pos,
+                            ext ? " id=%08lX EXT" : " id=%03lX", (unsigned long)frame.id);
+    if (frame.flags & CAN_FRAME_FLAG_RTR)
+    {
+      pos += (size_t)snprintf(&expected[pos], sizeof(expected) - pos, " RTR");
+    }
+    pos += (size_t)snprintf(&expected[pos], sizeof(expected) - pos, " dlc=%u", frame.dlc);
+    for (uint8_t i = 0; i < frame.dlc; ++i)
+    {
+      pos += (size_t)snprintf(&expected[pos], sizeof(expected) - pos, " %02X", frame.data[i]);
+    }
+    snprintf(&expected[pos], sizeof(expected) - pos, "\n");
+
+    check_line(dst, length, expected);
+  }
+
+  /* The documented wire cost of a standard 8-byte frame. */
+  uint32_t deltas[]  = { 100, 128, 16383, 16384, 2000000 };
+  size_t   lengths[] = { 16, 17, 17, 18, 18 };
+
+  frame.flags = 0;
+  frame.dlc   = 8;
+  memset(frame.data, 0x11, sizeof(frame.data));
+  for (size_t i = 0; i < (sizeof(deltas) / sizeof(deltas[0])); ++i)
+  {
+    frame.timestamp = timestamp + deltas[i];
+    CHECK(stream_encode_frame(dst, &frame) == lengths[i]);
+  }
+}
+
+static void test_text(void)
+{
+  static char    text[600];
+  static uint8_t dst[STREAM_ENCODED_SIZE(sizeof(text) + 2)];
+  static char    expected[LINE_SIZE];
+  size_t         length;
+  size_t         pos;
+
+  length = stream_encode_text(dst, "ID 0x123 \"ok\"\r\n", 15);
+  check_line(dst, length, "TEXT \"ID 0x123 \\\"ok\\\"\\r\\n\"\n");
+
+  /* Long enough for several full COBS groups, with embedded zeros. */
+  pos = (size_t)sprintf(expected, "TEXT \"");
+  for (size_t i = 0; i < sizeof(text); ++i)
+  {
+    text[i] = ((i % 300) == 299) ? '\0' : (char)('a' + (i % 26));
+    pos += (size_t)sprintf(&expected[pos], (text[i] == '\0') ? "\\x00" : "%c", text[i]);
+  }
+  sprintf(&expected[pos], "\"\n");
+
+  length = stream_encode_text(dst, text, sizeof(text));
+  CHECK(length <= sizeof(dst));
+  check_line(dst, length, expected);
+}
+
+static void test_events(void)
+{
+  uint8_t  dst[STREAM_EVENT_MAX_LENGTH];
+  uint32_t args[] = { 0xDEADBEEF, 0 };
+  size_t   length;
+
+  length = stream_encode_event(dst, 7, 123456789, NULL, 0);
+  check_line(dst, length, "EVENT t=123456789 id=7\n");
+
+  length = stream_encode_event(dst, 0x0100, 0, args, 2);
+  check_line(dst, length, "EVENT t=0 id=256 3735928559 0\n");
+
+  /* Excess arguments are dropped. */
+  length = stream_encode_event(dst, 1, 2, args, 5);
+  CHECK(length <= STREAM_EVENT_MAX_LENGTH);
+  check_line(dst, length, "EVENT t=2 id=1 3735928559 0\n");
+}
+
+static void test_stats(void)
+{
+  uint8_t           dst[STREAM_STATS_MAX_LENGTH];
+  can_stats_entry_t entry;
+  can_frame_t       frame = { .timestamp = 0, .id = 0x7E8, .dlc = 8, .bus = CAN_BUS_MS };
+  size_t            length;
+
+  memset(&entry, 0, sizeof(entry));
+  entry.id         = 0x18DAF110 | CAN_STATS_ID_EXT;
+  entry.count      = 1000;
+  entry.dlc        = 8;
+  entry.bus        = CAN_BUS_HS;
+  entry.period_min = 9980;
+  entry.period_avg = 10000 << CAN_STATS_AVG_SHIFT;
+  entry.period_max = 10050;
+  entry.jitter     = 12 << CAN_STATS_AVG_SHIFT;
+
+  length = stream_encode_stats(dst, &entry);
+  CHECK(length <= STREAM_STATS_MAX_LENGTH);
+  check_line(dst, length,
+             "STATS id=98DAF110 count=1000 dlc=8 bus=0 min=9980 avg=10000 max=10050 jitter=12\n");
+
+  /* Min is only meaningful after two frames. */
+  entry.count = 1;
+  length      = stream_encode_stats(dst, &entry);
+  check_line(dst, length,
+             "STATS id=98DAF110 count=1 dlc=8 bus=0 min=0 avg=10000 max=10050 jitter=12\n");
+
+  can_stats_reset();
+  for (uint32_t i = 0; i < 3; ++i)
+  {
+    frame.timestamp = i * 1000;
+    can_stats_update(&frame, 0);
+  }
+  length = stream_encode_stats_summary(dst, 1);
+  check_line(dst, length, "STATS END load=0.0/0.0/0.0 entries=1 frames=3 dropped=0\n");
+}
+
+static void test_others(void)
+{
+  uint8_t           dst[STREAM_ERRORS_MAX_LENGTH + STREAM_SNAPSHOT_MAX_LENGTH];
+  can_stats_entry_t entry;
+  can_errors_bus_t  errors;
+  capture_window_t  window = { .length = 200, .trigger = 100, .timestamp = 5000,
+                               .source = 2, .bus = CAN_BUS_MM };
+  can_frame_t       frame  = { .timestamp = 42, .id = 0x12345678, .flags = CAN_FRAME_FLAG_IDE,
+                               .dlc = 2, .bus = CAN_BUS_MM, .data = { 0xAB, 0x00 } };
+  size_t            length;
+
+  memset(&entry, 0, sizeof(entry));
+  entry.id             = 0x123;
+  entry.bus            = CAN_BUS_MS;
+  entry.dlc            = 3;
+  entry.last_timestamp = 99;
+  entry.data[0]        = 1;
+  entry.data[1]        = 2;
+  entry.data[2]        = 3;
+  length               = stream_encode_snapshot(dst, &entry);
+  check_line(dst, length, "SNAPSHOT t=99 bus=1 id=123 dlc=3 01 02 03\n");
+
+  length = stream_encode_snapshot_end(dst, 1, 100);
+  check_line(dst, length, "SNAPSHOT END entries=1 t=100\n");
+
+  memset(&errors, 0, sizeof(errors));
+  errors.state                          = CAN_ERRORS_STATE_PASSIVE;
+  errors.tec                            = 128;
+  errors.rec                            = 5;
+  errors.tec_max                        = 136;
+  errors.rec_max                        = 9;
+  errors.suppressed                     = 3;
+  errors.lec_count[CAN_ERRORS_LEC_ACK]  = 17;
+  errors.lec_count[CAN_ERRORS_LEC_CRC]  = 1;
+  length = stream_encode_errors(dst, CAN_BUS_HS, &errors);
+  check_line(dst, length,
+             "ERRORS bus=0 state=PASSIVE tec=128 rec=5 tec_max=136 rec_max=9 suppressed=3 "
+             "STUFF=0 FORM=0 ACK=17 BIT1=0 BIT0=0 CRC=1\n");
+
+  length = stream_encode_capture(dst, &frame);
+  check_line(dst, length, "CAPTURE t=42 bus=2 id=12345678 EXT dlc=2 AB 00\n");
+
+  length = stream_encode_capture_end(dst, &window);
+  check_line(dst, length, "CAPTURE END frames=200 trigger=100 t=5000 source=2 bus=2\n");
+
+  length = stream_encode_replay_report(dst, 12, -350);
+  check_line(dst, length, "REPLAY REPORT seq=12 err=-350\n");
+}
+
+static void test_corrupt(void)
+{
+  uint8_t     dst[STREAM_FRAME_MAX_LENGTH];
+  uint8_t     raw[STREAM_FRAME_MAX_LENGTH];
+  can_frame_t frame  = { .timestamp = 1, .id = 0x100, .dlc = 8,
+                         .data = { 1, 2, 3, 4, 5, 6, 7, 8 } };
+  size_t      length = stream_encode_frame(dst, &frame);
+
+  /* Every single bit flip of the body is caught by COBS or CRC. */
+  for (size_t i = 0; i < (length - 1); ++i)
+  {
+    for (uint8_t bit = 0; bit < 8; ++bit)
+    {
+      dst[i] ^= (uint8_t)(1 << bit);
+      if (dst[i] != 0)
+      {
+        CHECK(stream_decode(raw, dst, length - 1) == 0);
+      }
+      dst[i] ^= (uint8_t)(1 << bit);
+    }
+  }
+
+  /* Truncated records are rejected. */
+  for (size_t i = 0; i < (length - 1); ++i)
+  {
+    CHECK(stream_decode(raw, dst, i) == 0);
+  }
+  CHECK(stream_decode(raw, dst, length - 1) != 0);
+}
+
+/* Shared functions ========================================================= */
+int main(int argc, char * argv[])
+{
+  if (argc > 1)
+  {
+    random_state = (uint32_t)strtoul(argv[1], NULL, 0);
+    random_state = random_state ? random_state : 1;
+  }
+  printf("seed %lu\n", (unsigned long)random_state);
+
+  test_frames();
+  test_text();
+  test_events();
+  test_stats();
+  test_others();
+  test_corrupt();
+
+  printf("%s, %u failures\n", failures ? "FAILED" : "PASSED", failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
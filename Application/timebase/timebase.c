@@ -0,0 +1,72 @@
+/* Includes ================================================================= */
+#include "timebase.h"
+
+#include "stm32f1xx.h"
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+static uint32_t          cycles_per_us;
+
+/* Cycle count and microseconds at the last SysTick, updated as one unit. */
+static volatile uint32_t base_cycles;
+static volatile uint64_t base_us;
+static volatile uint32_t base_sequence;
+
+/* Private functions  ======================================================= */
+/* Shared functions ========================================================= */
+void timebase_init(void)
+{
+  cycles_per_us = SystemCoreClock / 1000000U;
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT       = 0;
+  DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+
+  base_cycles = 0;
+  base_us     = 0;
+}
+
+void timebase_tick(void)
+{
+  uint32_t elapsed_us;
+
+  if (cycles_per_us == 0)
+  {
+    return;
+  }
+
+  /* Readers in higher priority ISRs must never see a half updated base. */
+  __disable_irq();
+
+  elapsed_us   = (DWT->CYCCNT - base_cycles) / cycles_per_us;
+  base_cycles += elapsed_us * cycles_per_us;
+  base_us     += elapsed_us;
+  base_sequence++;
+
+  __enable_irq();
+}
+
+uint64_t timebase_get_us64(void)
+{
+  uint32_t sequence;
+  uint32_t cycles;
+  uint64_t us;
+
+  /* Retry if SysTick moved the base while it was being read. */
+  do
+  {
+    sequence = base_sequence;
+    cycles   = DWT->CYCCNT - base_cycles;
+    us       = base_us;
+  } while (sequence != base_sequence);
+
+  return us + (cycles / cycles_per_us);
+}
+
+uint32_t timebase_get_us(void)
+{
+  return (uint32_t)timebase_get_us64();
+}
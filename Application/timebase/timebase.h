@@ -0,0 +1,60 @@
+/** ========================================================================= *
+ *
+ * @brief Microsecond timebase driven by the DWT cycle counter.
+ *
+ *  ========================================================================= */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdint.h>
+
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+
+/**
+ * @brief Function for starting the cycle counter.
+ *
+ * Must be called after the system clock is configured, the cycles per
+ * microsecond are taken from SystemCoreClock.
+ */
+void timebase_init(void);
+
+/**
+ * @brief Extends the cycle counter, must be called from SysTick.
+ *
+ * CYCCNT wraps every 2^32 cycles (about 59 s at 72 MHz), so it only has to
+ * be sampled well within that period for the count to stay monotonic.
+ */
+void timebase_tick(void);
+
+/**
+ * @brief Returns the time since timebase_init() in microseconds.
+ *
+ * Safe to call from any context, including ISRs preempting SysTick.
+ *
+ * @return  64-bit microsecond counter.
+ */
+uint64_t timebase_get_us64(void);
+
+/**
+ * @brief Returns the low 32 bits of the microsecond counter.
+ *
+ * Wraps every ~71 minutes, intended for record timestamps and deltas.
+ *
+ * @return  32-bit microsecond counter.
+ */
+uint32_t timebase_get_us(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,177 @@
+/* Includes ================================================================= */
+#include "tx_queue.h"
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Private functions  ======================================================= */
+
+/**
+ * @brief Returns true if entry a has to be sent before entry b.
+ */
+static bool txq_before(const tx_queue_entry_t * p_a, const tx_queue_entry_t * p_b)
+{
+  if (p_a->key != p_b->key)
+  {
+    return p_a->key < p_b->key;
+  }
+
+  /* Sequence numbers wrap, only their distance matters. */
+  return (int32_t)(p_a->sequence - p_b->sequence) < 0;
+}
+
+static void txq_swap(tx_queue_entry_t * p_a, tx_queue_entry_t * p_b)
+{
+  tx_queue_entry_t entry = *p_a;
+
+  *p_a = *p_b;
+  *p_b = entry;
+}
+
+/* Shared functions ========================================================= */
+fifo_error_t
+tx_queue_init(tx_queue_t * p_queue, tx_queue_entry_t * p_buf, size_t capacity)
+{
+  if ((p_queue == NULL) || (p_buf == NULL))
+  {
+    return E_NULL;
+  }
+
+  if (capacity == 0)
+  {
+    return E_INVAL;
+  }
+
+  p_queue->p_buf         = p_buf;
+  p_queue->capacity      = capacity;
+  p_queue->count         = 0;
+  p_queue->high_water    = 0;
+  p_queue->sequence      = 0;
+  p_queue->dropped_count = 0;
+  p_queue->sent_count    = 0;
+  p_queue->wait_max      = 0;
+  p_queue->wait_avg      = 0;
+
+  return E_OK;
+}
+
+fifo_error_t tx_queue_push(tx_queue_t * p_queue, const can_frame_t * p_frame)
+{
+  tx_queue_entry_t * p_heap = p_queue->p_buf;
+  size_t             index  = p_queue->count;
+
+  if (index >= p_queue->capacity)
+  {
+    p_queue->dropped_count++;
+    return E_NOMEM;
+  }
+
+  p_heap[index].frame    = *p_frame;
+  p_heap[index].key      = tx_queue_arbitration_key(p_frame);
+  p_heap[index].sequence = p_queue->sequence++;
+
+  /* Sift up. */
+  while (index > 0)
+  {
+    size_t parent = (index - 1) / 2;
+
+    if (!txq_before(&p_heap[index], &p_heap[parent]))
+    {
+      break;
+    }
+
+    txq_swap(&p_heap[index], &p_heap[parent]);
+    index = parent;
+  }
+
+  p_queue->count++;
+  if (p_queue->count > p_queue->high_water)
+  {
+    p_queue->high_water = p_queue->count;
+  }
+
+  return E_OK;
+}
+
+const can_frame_t * tx_queue_peek(const tx_queue_t * p_queue)
+{
+  return (p_queue->count != 0) ? &p_queue->p_buf[0].frame : NULL;
+}
+
+fifo_error_t tx_queue_pop(tx_queue_t * p_queue, uint32_t now)
+{
+  tx_queue_entry_t * p_heap = p_queue->p_buf;
+  size_t             index  = 0;
+
+  if (p_queue->count == 0)
+  {
+    return E_EMPTY;
+  }
+
+  uint32_t wait = now - p_heap[0].frame.timestamp;
+
+  if (wait > p_queue->wait_max)
+  {
+    p_queue->wait_max = wait;
+  }
+  if (p_queue->sent_count == 0)
+  {
+    p_queue->wait_avg = wait << TX_QUEUE_AVG_SHIFT;
+  }
+  else
+  {
+    p_queue->wait_avg += wait - (p_queue->wait_avg >> TX_QUEUE_AVG_SHIFT);
+  }
+  p_queue->sent_count++;
+
+  p_queue->count--;
+  p_heap[0] = p_heap[p_queue->count];
+
+  /* Sift down. */
+  for (;;)
+  {
+    size_t first = index;
+    size_t left  = (2 * index) + 1;
+    size_t right = left + 1;
+
+    if ((left < p_queue->count) && txq_before(&p_heap[left], &p_heap[first]))
+    {
+      first = left;
+    }
+    if ((right < p_queue->count) && txq_before(&p_heap[right], &p_heap[first]))
+    {
+      first = right;
+    }
+    if (first == index)
+    {
+      break;
+    }
+
+    txq_swap(&p_heap[index], &p_heap[first]);
+    index = first;
+  }
+
+  return E_OK;
+}
+
+size_t tx_queue_get_depth(const tx_queue_t * p_queue)
+{
+  return p_queue->count;
+}
+
+uint32_t tx_queue_arbitration_key(const can_frame_t * p_frame)
+{
+  uint32_t rtr = (p_frame->flags & CAN_FRAME_FLAG_RTR) ? 1 : 0;
+
+  if (p_frame->flags & CAN_FRAME_FLAG_IDE)
+  {
+    /* Base ID, SRR (recessive), IDE (recessive), ID extension, RTR. */
+    return ((p_frame->id >> 18) << 21) | (1UL << 20) | (1UL << 19) |
+           ((p_frame->id & 0x3FFFF) << 1) | rtr;
+  }
+
+  /* Base ID, RTR, IDE (dominant), nothing after. */
+  return ((p_frame->id & 0x7FF) << 21) | (rtr << 20);
+}
@@ -0,0 +1,150 @@
+/** ========================================================================= *
+ *
+ * @brief Priority ordered CAN transmit queue.
+ *
+ * Frames wait here until a hardware mailbox is free. The queue is a binary
+ * heap ordered the way the bus arbitrates: the frame with the lowest
+ * arbitration field is popped first, frames with equal arbitration fields
+ * leave in the order they were pushed.
+ *
+ * The queue is not interrupt safe by itself, the caller has to serialize
+ * pushes from the main loop against pops from the TX ISR.
+ *
+ *  ========================================================================= */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "frame_fifo.h"
+
+/* Macros =================================================================== */
+
+/**
+ * @brief Defines a TX queue instance with compile-time capacity.
+ *
+ * The instance is statically initialized, so no tx_queue_init() call is
+ * needed.
+ *
+ * @param __name      Name of the tx_queue_t instance.
+ * @param __capacity  Amount of frames the queue holds.
+ */
+#define TX_QUEUE_DEFINE(__name, __capacity)                                   \
+  static tx_queue_entry_t __name##_buffer[(__capacity)];                      \
+  static tx_queue_t       __name = {                                          \
+    .p_buf = __name##_buffer, .capacity = (__capacity)                        \
+  }
+
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+
+/**
+ * @brief Queued frame with its position in the transmit order.
+ */
+typedef struct
+{
+  can_frame_t frame;    /**< Frame, timestamp is the time it was pushed. */
+  uint32_t    key;      /**< Arbitration field, lower wins. */
+  uint32_t    sequence; /**< Push order among equal keys. */
+} tx_queue_entry_t;
+
+/**
+ * @brief The TX queue control block.
+ */
+typedef struct
+{
+  tx_queue_entry_t * p_buf;         /**< Heap storage. */
+  size_t             capacity;      /**< Amount of entries in p_buf. */
+  size_t             count;         /**< Frames queued. */
+  size_t             high_water;    /**< Maximum amount of frames queued. */
+  uint32_t           sequence;      /**< Sequence of the next push. */
+  uint32_t           dropped_count; /**< Pushes rejected because of no space. */
+  uint32_t           sent_count;    /**< Frames popped. */
+  uint32_t           wait_max;      /**< Longest time a frame was queued. */
+  uint32_t           wait_avg;      /**< Averaged queued time, fixed point. */
+} tx_queue_t;
+
+/** Fixed point shift of tx_queue_t::wait_avg, weight of a new value is 1/16. */
+#define TX_QUEUE_AVG_SHIFT (4)
+
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+
+/**
+ * @brief Function for initializing the TX queue.
+ *
+ * @param[out] p_queue   Queue object.
+ * @param[in]  p_buf     Entry storage.
+ * @param[in]  capacity  Amount of entries in p_buf.
+ *
+ * @retval     E_OK    If initialization was successful.
+ * @retval     E_NULL  If a NULL pointer is provided as queue or storage.
+ * @retval     E_INVAL If the capacity is zero.
+ */
+fifo_error_t
+tx_queue_init(tx_queue_t * p_queue, tx_queue_entry_t * p_buf, size_t capacity);
+
+/**
+ * @brief Queues a frame.
+ *
+ * @param[in]  p_queue  Pointer to the queue.
+ * @param[in]  p_frame  Frame, its timestamp should be the current time.
+ *
+ * @retval E_OK     If the frame was queued.
+ * @retval E_NOMEM  If the queue is full, the dropped counter is incremented.
+ */
+fifo_error_t tx_queue_push(tx_queue_t * p_queue, const can_frame_t * p_frame);
+
+/**
+ * @brief Returns the frame that wins arbitration without removing it.
+ *
+ * @param[in]  p_queue  Pointer to the queue.
+ *
+ * @return  Pointer to the frame, or NULL if the queue is empty.
+ */
+const can_frame_t * tx_queue_peek(const tx_queue_t * p_queue);
+
+/**
+ * @brief Removes the frame returned by tx_queue_peek().
+ *
+ * @param[in]  p_queue  Pointer to the queue.
+ * @param[in]  now      Current time, same base as the frame timestamps.
+ *
+ * @retval E_OK     If the frame was removed and its wait time accounted.
+ * @retval E_EMPTY  If the queue is empty.
+ */
+fifo_error_t tx_queue_pop(tx_queue_t * p_queue, uint32_t now);
+
+/**
+ * @brief Returns the amount of frames queued.
+ *
+ * @param[in]  p_queue  Pointer to the queue.
+ *
+ * @return  Queue depth.
+ */
+size_t tx_queue_get_depth(const tx_queue_t * p_queue);
+
+/**
+ * @brief Returns the arbitration field of a frame.
+ *
+ * Base ID, SRR/RTR, IDE, ID extension and extended RTR in bus order, so a
+ * lower value wins arbitration.
+ *
+ * @param[in]  p_frame  Frame.
+ *
+ * @return  Arbitration key.
+ */
+uint32_t tx_queue_arbitration_key(const can_frame_t * p_frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
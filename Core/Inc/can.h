@@ -29,18 +29,40 @@ extern "C" {
 #include "main.h"
 
 /* USER CODE BEGIN Includes */
-
+#include "can_filter.h"
+#include "tx_queue.h"
 /* USER CODE END Includes */
 
 extern CAN_HandleTypeDef hcan2;
 
 /* USER CODE BEGIN Private defines */
+extern CAN_HandleTypeDef hcan1;
 
+/* ID ranges kept per controller */
+#define CAN_FILTER_RULES_MAX	(16)
+/* Frames waiting for a TX mailbox per controller */
+#define CAN_TX_QUEUE_SIZE		(32)
 /* USER CODE END Private defines */
 
 void MX_CAN2_Init(void);
 
 /* USER CODE BEGIN Prototypes */
+void Can_MsInit(void);
+void Can_AutoDetect(uint32_t *pKbit);
+HAL_StatusTypeDef Can_SetListenOnly(bool enable);
+bool Can_IsListenOnly(void);
+can_bus_t Can_GetBus(CAN_HandleTypeDef *hcan);
+void Can_ErrorsMain(void);
+HAL_StatusTypeDef Can_Transmit(CAN_HandleTypeDef *hcan, const can_frame_t *pFrame);
+const tx_queue_t *Can_GetTxQueue(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef Can_SetBitrate(CAN_HandleTypeDef *hcan, uint32_t kbit);
+can_filter_status_t Can_SetFilterRules(CAN_HandleTypeDef *hcan, const can_filter_rule_t *pRules, size_t count);
+can_filter_status_t Can_SetFilterAll(CAN_HandleTypeDef *hcan);
+size_t Can_GetFilterBankCount(CAN_HandleTypeDef *hcan);
+uint32_t Can_GetRxFullCount(uint32_t RxFifo);
+uint32_t Can_GetRxOverrunCount(uint32_t RxFifo);
+bool Can_RxIrqHandler(CAN_HandleTypeDef *hcan, uint32_t RxFifo);
+uint32_t Can_GetRxCyclesPerFrame(void);
 
 /* USER CODE END Prototypes */
 
@@ -46,6 +46,10 @@ extern "C" {
 #include "console.h"
 #include "obd2.h"
 #include "fast_fifo.h"
+#include "sniffer.h"
+#include "event_log.h"
+#include "timebase.h"
+#include "replay.h"
 /* USER CODE END Includes */
 
 /* Exported types ------------------------------------------------------------*/
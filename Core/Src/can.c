@@ -23,6 +23,39 @@
 /* USER CODE BEGIN 0 */
 #include "console.h"
 #include "obd2.h"
+#include "sniffer.h"
+#include "event_log.h"
+#include "can_stats.h"
+#include "iwdg.h"
+#include "can_errors.h"
+#include "capture.h"
+
+/* Bitrate detection budget per bus and bitrate candidate */
+#define CAN_AUTOBAUD_WINDOW_MS		(100)
+#define CAN_AUTOBAUD_FRAMES			(16)
+#define CAN_AUTOBAUD_MAX_ERRORS		(4)
+
+/* CAN1 on PB8/PB9 (MS bus) is brought up by Can_MsInit(), not by CubeMX */
+CAN_HandleTypeDef hcan1;
+
+/* Error state sampling period, leaving passive or bus-off raises no IRQ */
+#define CAN_ERRORS_SAMPLE_MS		(10)
+
+/* HAL error bits accounted by the error telemetry instead of event log */
+#define CAN_PROTOCOL_ERRORS			(HAL_CAN_ERROR_EWG | HAL_CAN_ERROR_EPV | HAL_CAN_ERROR_BOF | \
+									 HAL_CAN_ERROR_STF | HAL_CAN_ERROR_FOR | HAL_CAN_ERROR_ACK | \
+									 HAL_CAN_ERROR_BR | HAL_CAN_ERROR_BD | HAL_CAN_ERROR_CRC)
+
+/* Bus CAN2 is routed to, HS on PB12/PB13 or MM on remapped PB5/PB6 */
+static can_bus_t Can_Can2Bus = CAN_BUS_HS;
+
+/* Both controllers in silent mode: no ACK, no error frames, no TX */
+static bool Can_ListenOnly;
+
+/* Software TX queue of each controller, index 0 is CAN1, 1 is CAN2 */
+TX_QUEUE_DEFINE(Can_TxQueue1, CAN_TX_QUEUE_SIZE);
+TX_QUEUE_DEFINE(Can_TxQueue2, CAN_TX_QUEUE_SIZE);
+static tx_queue_t * const Can_TxQueues[2] = { &Can_TxQueue1, &Can_TxQueue2 };
 /* USER CODE END 0 */
 
 CAN_HandleTypeDef hcan2;
@@ -32,6 +65,7 @@ void MX_CAN2_Init(void)
 {
 
   /* USER CODE BEGIN CAN2_Init 0 */
+  can_errors_reset();
   MS_CAN_TRANSCEIVER_DISABLE();
   MM_CAN_TRANSCEIVER_DISABLE();
   HS_CAN_TRANSCEIVER_DISABLE();
@@ -41,11 +75,11 @@ void MX_CAN2_Init(void)
 
   /* USER CODE END CAN2_Init 1 */
   hcan2.Instance = CAN2;
-  hcan2.Init.Prescaler = 9;
+  hcan2.Init.Prescaler = 4;
   hcan2.Init.Mode = CAN_MODE_NORMAL;
   hcan2.Init.SyncJumpWidth = CAN_SJW_1TQ;
-  hcan2.Init.TimeSeg1 = CAN_BS1_3TQ;
-  hcan2.Init.TimeSeg2 = CAN_BS2_4TQ;
+  hcan2.Init.TimeSeg1 = CAN_BS1_14TQ;
+  hcan2.Init.TimeSeg2 = CAN_BS2_3TQ;
   hcan2.Init.TimeTriggeredMode = DISABLE;
   hcan2.Init.AutoBusOff = ENABLE;
   hcan2.Init.AutoWakeUp = ENABLE;
@@ -57,27 +91,20 @@ void MX_CAN2_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN CAN2_Init 2 */
-  	CAN_FilterTypeDef canFilterConfig;
-
-	canFilterConfig.FilterBank = 15;
-	canFilterConfig.FilterMode = CAN_FILTERMODE_IDMASK;
-	canFilterConfig.FilterScale = CAN_FILTERSCALE_32BIT;
-	canFilterConfig.FilterIdHigh = 0x07E8 << 5; // Filter IDs from 0x7E8
-	canFilterConfig.FilterIdLow = 0x0000;
-	canFilterConfig.FilterMaskIdHigh = 0x07FE << 5; // Filter IDs 0x7E8, 0x7E9 (Engine, Transmission)
-	canFilterConfig.FilterMaskIdLow = 0x0000;
-	canFilterConfig.FilterFIFOAssignment = CAN_RX_FIFO0;
-	canFilterConfig.FilterActivation = ENABLE;
-	canFilterConfig.SlaveStartFilterBank = 14;
-	HAL_CAN_ConfigFilter(&hcan2, &canFilterConfig);
+	static const can_filter_rule_t obd2Responses[] = {
+		{ 0x7E8, 0x7E9, false },	// Engine, Transmission
+	};
+	Can_SetFilterRules(&hcan2, obd2Responses, GET_SIZE(obd2Responses));
 	HAL_CAN_Start(&hcan2);
 
-	/* Enable FIFO0 pending ISR and TX mailbox empty ISR */
-	HAL_CAN_ActivateNotification(&hcan2, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_TX_MAILBOX_EMPTY);
+	/* Enable FIFO0/FIFO1 pending ISR and TX mailbox empty ISR */
+	HAL_CAN_ActivateNotification(&hcan2, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO1_MSG_PENDING | CAN_IT_TX_MAILBOX_EMPTY);
 
 	/* Enable AUX & error ISR's */
 	HAL_CAN_ActivateNotification(&hcan2, CAN_IT_RX_FIFO0_OVERRUN |
 										 CAN_IT_RX_FIFO0_FULL |
+										 CAN_IT_RX_FIFO1_OVERRUN |
+										 CAN_IT_RX_FIFO1_FULL |
 										 CAN_IT_WAKEUP |
 										 CAN_IT_SLEEP_ACK |
 										 CAN_IT_ERROR_WARNING |
@@ -125,7 +152,10 @@ void HAL_CAN_MspInit(CAN_HandleTypeDef* canHandle)
     HAL_NVIC_SetPriority(CAN2_RX0_IRQn, 0, 0);
     HAL_NVIC_EnableIRQ(CAN2_RX0_IRQn);
   /* USER CODE BEGIN CAN2_MspInit 1 */
-
+    HAL_NVIC_SetPriority(CAN2_RX1_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(CAN2_RX1_IRQn);
+    HAL_NVIC_SetPriority(CAN2_SCE_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(CAN2_SCE_IRQn);
   /* USER CODE END CAN2_MspInit 1 */
   }
 }
@@ -152,85 +182,741 @@ void HAL_CAN_MspDeInit(CAN_HandleTypeDef* canHandle)
     HAL_NVIC_DisableIRQ(CAN2_TX_IRQn);
     HAL_NVIC_DisableIRQ(CAN2_RX0_IRQn);
   /* USER CODE BEGIN CAN2_MspDeInit 1 */
-
+    HAL_NVIC_DisableIRQ(CAN2_RX1_IRQn);
+    HAL_NVIC_DisableIRQ(CAN2_SCE_IRQn);
   /* USER CODE END CAN2_MspDeInit 1 */
   }
 }
 
 /* USER CODE BEGIN 1 */
-void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
+/* Bit timings for 36 MHz APB1 clock, 18 tq per bit (1 + 14 + 3), sample
+ * point at 83.3% */
+static const struct {
+	uint32_t kbit;
+	uint32_t prescaler;
+} can_bitrates[] = {
+	{ 125, 16 },
+	{ 250, 8 },
+	{ 500, 4 },
+	{ 1000, 2 },
+};
+
+/* Bus the controller is wired to, frames are tagged with it */
+can_bus_t Can_GetBus(CAN_HandleTypeDef *hcan)
 {
-	uint8_t RxData[8];
-	CAN_RxHeaderTypeDef	RxHeader;
+	return (hcan->Instance == CAN1) ? CAN_BUS_MS : Can_Can2Bus;
+}
 
-	HAL_CAN_GetRxMessage(&hcan2, CAN_RX_FIFO0, &RxHeader, RxData);
-	Can_LedBlinkOnPacketReceived();
+HAL_StatusTypeDef Can_SetBitrate(CAN_HandleTypeDef *hcan, uint32_t kbit)
+{
+	for (uint32_t i = 0; i < GET_SIZE(can_bitrates); i++) {
+		if (can_bitrates[i].kbit != kbit) {
+			continue;
+		}
+
+		/* Bit timing is writable in initialization mode only, filters and
+		 * enabled notifications are kept */
+		HAL_CAN_Stop(hcan);
+		hcan->Init.Prescaler = can_bitrates[i].prescaler;
+		hcan->Init.SyncJumpWidth = CAN_SJW_1TQ;
+		hcan->Init.TimeSeg1 = CAN_BS1_14TQ;
+		hcan->Init.TimeSeg2 = CAN_BS2_3TQ;
+		if (HAL_CAN_Init(hcan) != HAL_OK) {
+			return HAL_ERROR;
+		}
+		can_stats_set_bitrate(Can_GetBus(hcan), kbit * 1000);
+		return HAL_CAN_Start(hcan);
+	}
+
+	return HAL_ERROR;
+}
+
+/* Switches both controllers between normal and silent mode. Silent mode
+ * keeps receiving at full rate, transmitted frames only loop back
+ * internally and never reach the bus */
+HAL_StatusTypeDef Can_SetListenOnly(bool enable)
+{
+	CAN_HandleTypeDef *handles[] = { &hcan1, &hcan2 };
+	HAL_StatusTypeDef status = HAL_OK;
+
+	for (uint32_t i = 0; i < GET_SIZE(handles); i++) {
+		CAN_HandleTypeDef *hcan = handles[i];
+
+		if (hcan->Instance == NULL) {
+			continue;
+		}
+
+		HAL_CAN_Stop(hcan);
+		hcan->Init.Mode = enable ? CAN_MODE_SILENT : CAN_MODE_NORMAL;
+		if (HAL_CAN_Init(hcan) != HAL_OK || HAL_CAN_Start(hcan) != HAL_OK) {
+			status = HAL_ERROR;
+		}
+	}
+
+	Can_ListenOnly = enable;
+	event_log_push(EVENT_LISTEN_ONLY, enable, 0);
+	return status;
+}
+
+bool Can_IsListenOnly(void)
+{
+	return Can_ListenOnly;
+}
+
+/* CAN1 init, runs after MX_CAN2_Init() which enables the CAN1 clock. Both
+ * controllers interrupt at the same priority, so their RX ISRs never nest
+ * and frames enter the sniffer FIFO in timestamp order */
+void Can_MsInit(void)
+{
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+	__HAL_RCC_CAN1_CLK_ENABLE();
+	__HAL_RCC_GPIOB_CLK_ENABLE();
+	__HAL_AFIO_REMAP_CAN1_2();
+
+	/**CAN1 GPIO Configuration
+	PB8     ------> CAN1_RX
+	PB9     ------> CAN1_TX
+	*/
+	GPIO_InitStruct.Pin = GPIO_PIN_8;
+	GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+	GPIO_InitStruct.Pin = GPIO_PIN_9;
+	GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+	HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+	hcan1.Instance = CAN1;
+	hcan1.Init = hcan2.Init;
+	hcan1.Init.Prescaler = can_bitrates[0].prescaler;
+	hcan1.Init.SyncJumpWidth = CAN_SJW_1TQ;
+	hcan1.Init.TimeSeg1 = CAN_BS1_14TQ;
+	hcan1.Init.TimeSeg2 = CAN_BS2_3TQ;
+	if (HAL_CAN_Init(&hcan1) != HAL_OK) {
+		Error_Handler();
+	}
+	can_stats_set_bitrate(CAN_BUS_MS, can_bitrates[0].kbit * 1000);
+
+	/* Comfort bus IDs are not known in advance, take everything */
+	Can_SetFilterAll(&hcan1);
+	HAL_CAN_Start(&hcan1);
+
+	HAL_CAN_ActivateNotification(&hcan1, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO1_MSG_PENDING | CAN_IT_TX_MAILBOX_EMPTY);
+	HAL_CAN_ActivateNotification(&hcan1, CAN_IT_RX_FIFO0_OVERRUN |
+										 CAN_IT_RX_FIFO0_FULL |
+										 CAN_IT_RX_FIFO1_OVERRUN |
+										 CAN_IT_RX_FIFO1_FULL |
+										 CAN_IT_ERROR_WARNING |
+										 CAN_IT_ERROR_PASSIVE |
+										 CAN_IT_BUSOFF |
+										 CAN_IT_LAST_ERROR_CODE |
+										 CAN_IT_ERROR);
+
+	HAL_NVIC_SetPriority(CAN1_TX_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(CAN1_TX_IRQn);
+	HAL_NVIC_SetPriority(CAN1_RX0_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(CAN1_RX0_IRQn);
+	HAL_NVIC_SetPriority(CAN1_RX1_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(CAN1_RX1_IRQn);
+	HAL_NVIC_SetPriority(CAN1_SCE_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(CAN1_SCE_IRQn);
+
+	MS_CAN_TRANSCEIVER_ENABLE();
+}
+
+static volatile uint32_t Can_RxFullCount[2];
+static volatile uint32_t Can_RxOverrunCount[2];
+static volatile uint32_t Can_RxFrameCount;
+static volatile uint32_t Can_RxCycleCount;
+
+/* Filter set of each controller, index 0 is CAN1, 1 is CAN2 */
+static can_filter_rule_t Can_FilterRules[2][CAN_FILTER_RULES_MAX];
+static size_t Can_FilterRuleCount[2];
+static bool Can_FilterSniffAll[2];
+
+/* Sniff all mode: every frame passes, standard ID bit 0 (bit 18 of extended
+ * IDs) selects the FIFO, so both hardware FIFOs share the bus load */
+static const can_filter_bank_t Can_SniffAllBanks[] = {
+	{ CAN_FILTER_BANK_MASK32, 0, 0, 0x00000000, 0x00200000 },
+	{ CAN_FILTER_BANK_MASK32, 1, 0, 0x00200000, 0x00200000 },
+};
+
+static uint32_t Can_FilterIndex(CAN_HandleTypeDef *hcan)
+{
+	return (hcan->Instance == CAN1) ? 0 : 1;
+}
+
+static size_t Can_FilterNeed(uint32_t index)
+{
+	size_t need = Can_FilterSniffAll[index] ? GET_SIZE(Can_SniffAllBanks) :
+				  can_filter_count_banks(Can_FilterRules[index], Can_FilterRuleCount[index]);
+
+	return (need > CAN_FILTER_BANK_COUNT) ? CAN_FILTER_BANK_COUNT : need;
+}
+
+/* Filter registers of both controllers are in CAN1, banks from split on
+ * belong to CAN2. Reception pauses while FINIT is set */
+static void Can_WriteFilterBanks(const can_filter_bank_t *pBanks, size_t split, const size_t *pUsed)
+{
+	CAN1->FMR |= CAN_FMR_FINIT;
+	CAN1->FMR = (CAN1->FMR & ~CAN_FMR_CAN2SB) | (split << CAN_FMR_CAN2SB_Pos);
+	CAN1->FA1R = 0;
+
+	for (uint32_t bank = 0; bank < CAN_FILTER_BANK_COUNT; bank++) {
+		const can_filter_bank_t *pBank = &pBanks[bank];
+		uint32_t bit = 1UL << bank;
+		size_t offset = (bank < split) ? bank : (bank - split);
+
+		if (offset >= pUsed[(bank < split) ? 0 : 1]) {
+			continue;
+		}
+
+		if (pBank->mode == CAN_FILTER_BANK_LIST16 || pBank->mode == CAN_FILTER_BANK_LIST32) {
+			CAN1->FM1R |= bit;
+		}
+		else {
+			CAN1->FM1R &= ~bit;
+		}
+		if (pBank->mode == CAN_FILTER_BANK_LIST32 || pBank->mode == CAN_FILTER_BANK_MASK32) {
+			CAN1->FS1R |= bit;
+		}
+		else {
+			CAN1->FS1R &= ~bit;
+		}
+		if (pBank->fifo) {
+			CAN1->FFA1R |= bit;
+		}
+		else {
+			CAN1->FFA1R &= ~bit;
+		}
+
+		CAN1->sFilterRegister[bank].FR1 = pBank->fr1;
+		CAN1->sFilterRegister[bank].FR2 = pBank->fr2;
+		CAN1->FA1R |= bit;
+	}
+
+	CAN1->FMR &= ~CAN_FMR_FINIT;
+}
 
-	console_print("%.8lu RX: ID=0x%X DLC=%lu %.2X %.2X %.2X %.2X %.2X %.2X %.2X %.2X\r\n",
-				HAL_GetTick(), RxHeader.StdId, RxHeader.DLC,
-				RxData[0], RxData[1], RxData[2], RxData[3], RxData[4], RxData[5], RxData[6], RxData[7]);
+/* Compiles both filter sets, rebalances the banks between CAN1 and CAN2 and
+ * programs them. Registers are not touched if a set does not fit */
+static can_filter_status_t Can_ApplyFilters(void)
+{
+	can_filter_bank_t banks[CAN_FILTER_BANK_COUNT];
+	can_filter_status_t result = CAN_FILTER_OK;
+	size_t split = can_filter_split(Can_FilterNeed(0), Can_FilterNeed(1));
+	size_t first[2] = { 0, split };
+	size_t budget[2] = { split, CAN_FILTER_BANK_COUNT - split };
+	size_t used[2];
+
+	for (uint32_t i = 0; i < 2; i++) {
+		can_filter_status_t status = CAN_FILTER_OK;
+
+		if (Can_FilterSniffAll[i]) {
+			used[i] = GET_SIZE(Can_SniffAllBanks);
+			if (used[i] > budget[i]) {
+				return CAN_FILTER_E_NOSPACE;
+			}
+			for (size_t j = 0; j < used[i]; j++) {
+				banks[first[i] + j] = Can_SniffAllBanks[j];
+			}
+		}
+		else {
+			status = can_filter_compile(Can_FilterRules[i], Can_FilterRuleCount[i],
+										&banks[first[i]], budget[i], &used[i]);
+		}
+
+		if (status == CAN_FILTER_WIDENED) {
+			result = CAN_FILTER_WIDENED;
+		}
+		else if (status != CAN_FILTER_OK) {
+			return status;
+		}
+	}
+
+	Can_WriteFilterBanks(banks, split, used);
+	return result;
+}
+
+/* Accepts the IDs and ID ranges of the set, everything else is rejected in
+ * hardware. Previous set is kept if the new one does not fit */
+can_filter_status_t Can_SetFilterRules(CAN_HandleTypeDef *hcan, const can_filter_rule_t *pRules, size_t count)
+{
+	uint32_t index = Can_FilterIndex(hcan);
+	can_filter_rule_t previous[CAN_FILTER_RULES_MAX];
+	size_t previousCount = Can_FilterRuleCount[index];
+	bool previousSniffAll = Can_FilterSniffAll[index];
+	can_filter_status_t status;
+
+	if (count > CAN_FILTER_RULES_MAX) {
+		return CAN_FILTER_E_NOSPACE;
+	}
 
-	// Check Engine Response ID
-	if (RxHeader.StdId == 0x7E8) {
-		obd2_parse_packet(RxData, GET_SIZE(RxData));
+	for (size_t i = 0; i < previousCount; i++) {
+		previous[i] = Can_FilterRules[index][i];
+	}
+	for (size_t i = 0; i < count; i++) {
+		Can_FilterRules[index][i] = pRules[i];
 	}
+	Can_FilterRuleCount[index] = count;
+	Can_FilterSniffAll[index] = false;
+
+	status = Can_ApplyFilters();
+	if (status != CAN_FILTER_OK && status != CAN_FILTER_WIDENED) {
+		for (size_t i = 0; i < previousCount; i++) {
+			Can_FilterRules[index][i] = previous[i];
+		}
+		Can_FilterRuleCount[index] = previousCount;
+		Can_FilterSniffAll[index] = previousSniffAll;
+	}
+
+	return status;
+}
+
+can_filter_status_t Can_SetFilterAll(CAN_HandleTypeDef *hcan)
+{
+	uint32_t index = Can_FilterIndex(hcan);
+	bool previousSniffAll = Can_FilterSniffAll[index];
+	can_filter_status_t status;
+
+	Can_FilterSniffAll[index] = true;
+	status = Can_ApplyFilters();
+	if (status != CAN_FILTER_OK && status != CAN_FILTER_WIDENED) {
+		Can_FilterSniffAll[index] = previousSniffAll;
+	}
+
+	return status;
+}
+
+size_t Can_GetFilterBankCount(CAN_HandleTypeDef *hcan)
+{
+	return Can_FilterNeed(Can_FilterIndex(hcan));
+}
+
+/* Routes CAN2 to the HS or MM transceiver, pins of the other one are left
+ * floating */
+static void Can_SelectCan2Bus(can_bus_t bus)
+{
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+	bool mm = (bus == CAN_BUS_MM);
+
+	GPIO_InitStruct.Pin = mm ? (GPIO_PIN_12 | GPIO_PIN_13) : (GPIO_PIN_5 | GPIO_PIN_6);
+	GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
+	HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+	if (mm) {
+		HS_CAN_TRANSCEIVER_DISABLE();
+		__HAL_AFIO_REMAP_CAN2_ENABLE();
+	}
+	else {
+		MM_CAN_TRANSCEIVER_DISABLE();
+		__HAL_AFIO_REMAP_CAN2_DISABLE();
+	}
+
+	GPIO_InitStruct.Pin = mm ? GPIO_PIN_5 : GPIO_PIN_12;
+	GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+	GPIO_InitStruct.Pin = mm ? GPIO_PIN_6 : GPIO_PIN_13;
+	GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+	HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+	if (mm) {
+		MM_CAN_TRANSCEIVER_ENABLE();
+	}
+	else {
+		HS_CAN_TRANSCEIVER_ENABLE();
+	}
+	Can_Can2Bus = bus;
+}
+
+/* Counts frames received at the current bit timing within the time budget,
+ * minus the receive errors seen meanwhile. Gives up early once the bitrate
+ * is obviously right or wrong */
+static uint32_t Can_ScoreBitrate(CAN_HandleTypeDef *hcan)
+{
+	CAN_RxHeaderTypeDef header;
+	uint8_t data[8];
+	uint32_t frames = 0;
+	uint32_t errors = 0;
+	uint32_t start = HAL_GetTick();
+
+	/* LEC 7 is never set by hardware, any other value is a new result */
+	hcan->Instance->ESR = CAN_ESR_LEC;
+
+	while ((HAL_GetTick() - start) < CAN_AUTOBAUD_WINDOW_MS && frames < CAN_AUTOBAUD_FRAMES) {
+		uint32_t lec = hcan->Instance->ESR & CAN_ESR_LEC;
+
+		if (lec != 0 && lec != CAN_ESR_LEC) {
+			if (++errors > CAN_AUTOBAUD_MAX_ERRORS) {
+				return 0;
+			}
+			hcan->Instance->ESR = CAN_ESR_LEC;
+		}
+
+		while (HAL_CAN_GetRxFifoFillLevel(hcan, CAN_RX_FIFO0) != 0 &&
+			   HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &header, data) == HAL_OK) {
+			frames++;
+		}
+		while (HAL_CAN_GetRxFifoFillLevel(hcan, CAN_RX_FIFO1) != 0 &&
+			   HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO1, &header, data) == HAL_OK) {
+			frames++;
+		}
+	}
+
+	return (frames > errors) ? (frames - errors) : 0;
+}
+
+/* Tries every bitrate in silent mode, so the controller never ACKs or sends
+ * error frames. All frames are accepted and interrupts are masked meanwhile,
+ * configuration is restored afterwards. Returns 0 if nothing was received */
+static uint32_t Can_DetectBitrate(CAN_HandleTypeDef *hcan)
+{
+	uint32_t index = Can_FilterIndex(hcan);
+	bool sniffAll = Can_FilterSniffAll[index];
+	CAN_InitTypeDef init = hcan->Init;
+	uint32_t ier = hcan->Instance->IER;
+	uint32_t bestKbit = 0;
+	uint32_t bestScore = 0;
+
+	__HAL_CAN_DISABLE_IT(hcan, ier);
+	Can_FilterSniffAll[index] = true;
+	Can_ApplyFilters();
+
+	for (uint32_t i = 0; i < GET_SIZE(can_bitrates); i++) {
+		HAL_CAN_Stop(hcan);
+		hcan->Init.Mode = CAN_MODE_SILENT;
+		hcan->Init.Prescaler = can_bitrates[i].prescaler;
+		hcan->Init.SyncJumpWidth = CAN_SJW_1TQ;
+		hcan->Init.TimeSeg1 = CAN_BS1_14TQ;
+		hcan->Init.TimeSeg2 = CAN_BS2_3TQ;
+
+		/* Start fails if no 11 recessive bits are seen, bitrate is wrong then */
+		if (HAL_CAN_Init(hcan) == HAL_OK && HAL_CAN_Start(hcan) == HAL_OK) {
+			uint32_t score = Can_ScoreBitrate(hcan);
+
+			if (score > bestScore) {
+				bestScore = score;
+				bestKbit = can_bitrates[i].kbit;
+			}
+		}
+		HAL_IWDG_Refresh(&hiwdg);
+	}
+
+	HAL_CAN_Stop(hcan);
+	hcan->Init = init;
+	HAL_CAN_Init(hcan);
+	Can_FilterSniffAll[index] = sniffAll;
+	Can_ApplyFilters();
+	HAL_CAN_Start(hcan);
+	__HAL_CAN_ENABLE_IT(hcan, ier);
+
+	return bestKbit;
+}
+
+/* Detects the bitrate of the MS, HS and MM bus and applies it. CAN2 stays on
+ * HS unless only MM is active. Takes up to 1.2 s on silent buses */
+void Can_AutoDetect(uint32_t *pKbit)
+{
+	pKbit[CAN_BUS_MS] = Can_DetectBitrate(&hcan1);
+	Can_SelectCan2Bus(CAN_BUS_MM);
+	pKbit[CAN_BUS_MM] = Can_DetectBitrate(&hcan2);
+	Can_SelectCan2Bus(CAN_BUS_HS);
+	pKbit[CAN_BUS_HS] = Can_DetectBitrate(&hcan2);
+
+	if (pKbit[CAN_BUS_MS] != 0) {
+		Can_SetBitrate(&hcan1, pKbit[CAN_BUS_MS]);
+	}
+	if (pKbit[CAN_BUS_HS] != 0) {
+		Can_SetBitrate(&hcan2, pKbit[CAN_BUS_HS]);
+	}
+	else if (pKbit[CAN_BUS_MM] != 0) {
+		Can_SelectCan2Bus(CAN_BUS_MM);
+		Can_SetBitrate(&hcan2, pKbit[CAN_BUS_MM]);
+	}
+}
+
+/* Loads queued frames into free mailboxes, lowest arbitration field first.
+ * Runs in the ISR that freed a mailbox, or after a push with interrupts
+ * disabled */
+static void Can_TxRefill(CAN_HandleTypeDef *hcan)
+{
+	tx_queue_t *pQueue = Can_TxQueues[Can_FilterIndex(hcan)];
+	const can_frame_t *pFrame;
+
+	while (HAL_CAN_GetTxMailboxesFreeLevel(hcan) != 0 && (pFrame = tx_queue_peek(pQueue)) != NULL) {
+		CAN_TxHeaderTypeDef header;
+		uint32_t mailbox;
+
+		header.IDE = (pFrame->flags & CAN_FRAME_FLAG_IDE) ? CAN_ID_EXT : CAN_ID_STD;
+		header.StdId = pFrame->id & 0x7FF;
+		header.ExtId = pFrame->id;
+		header.RTR = (pFrame->flags & CAN_FRAME_FLAG_RTR) ? CAN_RTR_REMOTE : CAN_RTR_DATA;
+		header.DLC = pFrame->dlc;
+		header.TransmitGlobalTime = DISABLE;
+
+		/* Fails only if the controller is stopped, frames wait for restart */
+		if (HAL_CAN_AddTxMessage(hcan, &header, (uint8_t *)pFrame->data, &mailbox) != HAL_OK) {
+			break;
+		}
+		tx_queue_pop(pQueue, timebase_get_us());
+	}
+}
+
+/* Queues the frame for transmission, it goes out as soon as a mailbox is
+ * free and no queued frame with lower ID is waiting. HAL_BUSY if the queue
+ * is full */
+HAL_StatusTypeDef Can_Transmit(CAN_HandleTypeDef *hcan, const can_frame_t *pFrame)
+{
+	can_frame_t frame = *pFrame;
+	uint32_t primask = __get_PRIMASK();
+	fifo_error_t error;
+
+	frame.timestamp = timebase_get_us();
+	frame.bus = Can_GetBus(hcan);
+
+	/* TX and error ISRs pop from the same heap */
+	__disable_irq();
+	error = tx_queue_push(Can_TxQueues[Can_FilterIndex(hcan)], &frame);
+	Can_TxRefill(hcan);
+	__set_PRIMASK(primask);
+
+	return (error == E_OK) ? HAL_OK : HAL_BUSY;
+}
+
+/* Depth, drops and wait times of the TX queue, wait times in microseconds */
+const tx_queue_t *Can_GetTxQueue(CAN_HandleTypeDef *hcan)
+{
+	return Can_TxQueues[Can_FilterIndex(hcan)];
+}
+
+uint32_t Can_GetRxFullCount(uint32_t RxFifo)
+{
+	return Can_RxFullCount[RxFifo & 1];
+}
+
+uint32_t Can_GetRxOverrunCount(uint32_t RxFifo)
+{
+	return Can_RxOverrunCount[RxFifo & 1];
+}
+
+/* Copies all frames pending in the FIFO straight from mailbox registers to
+ * sniffer FIFO, all the processing is done later in main loop. Returns the
+ * amount of frames released */
+static uint32_t Can_DrainFifo(CAN_HandleTypeDef *hcan, uint32_t RxFifo)
+{
+	uint32_t count = 0;
+	CAN_FIFOMailBox_TypeDef *pMailbox = &hcan->Instance->sFIFOMailBox[RxFifo];
+	volatile uint32_t *pRFR = (RxFifo == CAN_RX_FIFO0) ? &hcan->Instance->RF0R : &hcan->Instance->RF1R;
+
+	while (*pRFR & CAN_RF0R_FMP0) {
+		/* Stamp first, before mailbox is read out */
+		uint32_t timestamp = timebase_get_us();
+		uint32_t rir = pMailbox->RIR;
+		can_frame_t *p_frame = sniffer_rx_acquire();
+
+		if (p_frame != NULL) {
+			p_frame->timestamp = timestamp;
+			p_frame->id = (rir & CAN_RI0R_IDE) ? (rir >> CAN_RI0R_EXID_Pos) : (rir >> CAN_RI0R_STID_Pos);
+			/* IDE is bit 2, RTR bit 1 of RIR */
+			p_frame->flags = ((rir & CAN_RI0R_IDE) ? CAN_FRAME_FLAG_IDE : 0) |
+							 ((rir & CAN_RI0R_RTR) ? CAN_FRAME_FLAG_RTR : 0);
+			p_frame->dlc = (uint8_t)(pMailbox->RDTR & CAN_RDT0R_DLC);
+			p_frame->bus = Can_GetBus(hcan);
+			/* Payload is word aligned in can_frame_t */
+			((uint32_t *)p_frame->data)[0] = pMailbox->RDLR;
+			((uint32_t *)p_frame->data)[1] = pMailbox->RDHR;
+		}
+
+		/* Release mailbox, written directly so FULL/FOVR flags are kept for HAL.
+		 * Frame is dropped here if there is no free slot */
+		*pRFR = CAN_RF0R_RFOM0;
+		count++;
+
+		if (p_frame != NULL) {
+			sniffer_rx_commit();
+		}
+	}
+
+	Can_LedBlinkOnPacketReceived();
+	return count;
+}
+
+/* RX interrupt fast path, called on ISR entry. Returns false if HAL handler
+ * must run for FIFO full/overrun status */
+bool Can_RxIrqHandler(CAN_HandleTypeDef *hcan, uint32_t RxFifo)
+{
+	uint32_t cycles = DWT->CYCCNT;
+	volatile uint32_t *pRFR = (RxFifo == CAN_RX_FIFO0) ? &hcan->Instance->RF0R : &hcan->Instance->RF1R;
+
+	/* Only frames drained here are timed, so the HAL fallback path does not
+	 * dilute the per-frame figure */
+	Can_RxFrameCount += Can_DrainFifo(hcan, RxFifo);
+	Can_RxCycleCount += DWT->CYCCNT - cycles;
+
+	/* Halve both before the sum wraps, the ratio is kept */
+	if (Can_RxCycleCount & 0x80000000) {
+		Can_RxCycleCount >>= 1;
+		Can_RxFrameCount >>= 1;
+	}
+
+	return (*pRFR & (CAN_RF0R_FULL0 | CAN_RF0R_FOVR0)) == 0;
+}
+
+/* Average RX ISR cost per received frame in CPU cycles */
+uint32_t Can_GetRxCyclesPerFrame(void)
+{
+	return (Can_RxFrameCount) ? (Can_RxCycleCount / Can_RxFrameCount) : 0;
+}
+
+void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
+{
+	Can_DrainFifo(hcan, CAN_RX_FIFO0);
 }
 
 void HAL_CAN_RxFifo0FullCallback(CAN_HandleTypeDef *hcan){
-	console_print("%.8lu RX (FIFO=0) Full!\r\n", HAL_GetTick());
+	Can_RxFullCount[0]++;
+	event_log_push(EVENT_RX_FIFO_FULL, 0, 0);
 }
 
 void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan){
-	uint8_t RxData[8];
-	CAN_RxHeaderTypeDef	RxHeader;
+	Can_DrainFifo(hcan, CAN_RX_FIFO1);
+}
+
+void HAL_CAN_RxFifo1FullCallback(CAN_HandleTypeDef *hcan){
+	Can_RxFullCount[1]++;
+	event_log_push(EVENT_RX_FIFO_FULL, 1, 0);
+}
 
-	HAL_CAN_GetRxMessage(&hcan2, CAN_RX_FIFO1, &RxHeader, RxData);
+/* Feeds the error counters, state and last error code to the telemetry,
+ * state transitions are logged with their timestamp */
+static void Can_AccountErrors(CAN_HandleTypeDef *hcan, uint32_t error)
+{
+	/* HAL has already cleared LEC in ESR, the code is in the error bits */
+	static const struct {
+		uint32_t error;
+		can_errors_lec_t lec;
+	} lecs[] = {
+		{ HAL_CAN_ERROR_STF, CAN_ERRORS_LEC_STUFF },
+		{ HAL_CAN_ERROR_FOR, CAN_ERRORS_LEC_FORM },
+		{ HAL_CAN_ERROR_ACK, CAN_ERRORS_LEC_ACK },
+		{ HAL_CAN_ERROR_BR, CAN_ERRORS_LEC_BIT1 },
+		{ HAL_CAN_ERROR_BD, CAN_ERRORS_LEC_BIT0 },
+		{ HAL_CAN_ERROR_CRC, CAN_ERRORS_LEC_CRC },
+	};
+	uint8_t bus = Can_GetBus(hcan);
+	uint32_t esr = hcan->Instance->ESR;
+	bool report = false;
+	bool accounted = false;
+
+	for (uint32_t i = 0; i < GET_SIZE(lecs); i++) {
+		if (error & lecs[i].error) {
+			report |= can_errors_update(bus, esr, lecs[i].lec);
+			accounted = true;
+		}
+	}
+	if (!accounted) {
+		report = can_errors_update(bus, esr, CAN_ERRORS_LEC_NONE);
+	}
 
-	console_print("%.8lu RX: ID=0x%X DLC=%lu %.2X %.2X %.2X %.2X %.2X %.2X %.2X %.2X\r\n",
-					HAL_GetTick(), RxHeader.StdId, RxHeader.DLC,
-					RxData[0], RxData[1], RxData[2], RxData[3], RxData[4], RxData[5], RxData[6], RxData[7]);
+	if (report) {
+		const can_errors_bus_t *pBus = can_errors_get(bus);
+		event_log_push(EVENT_CAN_STATE, bus | ((uint32_t)pBus->state << 8),
+					   pBus->tec | ((uint32_t)pBus->rec << 8));
+	}
 }
 
-void HAL_CAN_RxFifo1FullCallback(CAN_HandleTypeDef *hcan){
-	console_print("%.8lu RX (FIFO=1) Full!\r\n", HAL_GetTick());
+/* Samples the error state of both controllers, called from main loop */
+void Can_ErrorsMain(void)
+{
+	static uint32_t lastSample;
+	CAN_HandleTypeDef *handles[] = { &hcan1, &hcan2 };
+
+	if ((HAL_GetTick() - lastSample) < CAN_ERRORS_SAMPLE_MS) {
+		return;
+	}
+	lastSample = HAL_GetTick();
+
+	for (uint32_t i = 0; i < GET_SIZE(handles); i++) {
+		if (handles[i]->Instance == NULL) {
+			continue;
+		}
+
+		/* Error ISR updates the same bus */
+		__disable_irq();
+		Can_AccountErrors(handles[i], 0);
+		__enable_irq();
+	}
 }
 
 void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan){
-	console_print("%.8lu CAN ERROR=0x%.8X\r\n", HAL_GetTick(), HAL_CAN_GetError(&hcan2));
-	HAL_CAN_ResetError(&hcan2);
+	uint32_t error = HAL_CAN_GetError(hcan);
+
+	/* Frames lost in hardware, counted apart from sniffer FIFO overflows */
+	if (error & HAL_CAN_ERROR_RX_FOV0) {
+		Can_RxOverrunCount[0]++;
+	}
+	if (error & HAL_CAN_ERROR_RX_FOV1) {
+		Can_RxOverrunCount[1]++;
+	}
+
+	/* Protocol errors are counted and reported rate limited, pushing each
+	 * one floods the console on a noisy bus */
+	Can_AccountErrors(hcan, error);
+	if (error & CAN_PROTOCOL_ERRORS) {
+		/* FIFO overruns and TX status are local, they never trigger a capture */
+		capture_error(Can_GetBus(hcan), timebase_get_us());
+	}
+	if (error & ~CAN_PROTOCOL_ERRORS) {
+		event_log_push(EVENT_CAN_ERROR, error & ~CAN_PROTOCOL_ERRORS, 0);
+	}
+	HAL_CAN_ResetError(hcan);
+
+	/* Failed transmission frees the mailbox too, retransmission is off */
+	Can_TxRefill(hcan);
 	Error_LedShortBlink();
 }
 
 void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan){
-	console_print("%.8lu TX (MBX=0) OK!\r\n", HAL_GetTick());
+	event_log_push(EVENT_TX_MAILBOX_COMPLETE, 0, 0);
+	Can_TxRefill(hcan);
 }
 
 void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan){
-	console_print("%.8lu TX (MBX=1) OK!\r\n", HAL_GetTick());
+	event_log_push(EVENT_TX_MAILBOX_COMPLETE, 1, 0);
+	Can_TxRefill(hcan);
 }
 
 void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan){
-	console_print("%.8lu TX (MBX=2) OK!\r\n", HAL_GetTick());
+	event_log_push(EVENT_TX_MAILBOX_COMPLETE, 2, 0);
+	Can_TxRefill(hcan);
 }
 
 void HAL_CAN_TxMailbox0AbortCallback(CAN_HandleTypeDef *hcan){
-	console_print("%.8lu TX (MBX=0) Abort!\r\n", HAL_GetTick());
+	event_log_push(EVENT_TX_MAILBOX_ABORT, 0, 0);
+	Can_TxRefill(hcan);
 }
 
 void HAL_CAN_TxMailbox1AbortCallback(CAN_HandleTypeDef *hcan){
-	console_print("%.8lu TX (MBX=1) Abort!\r\n", HAL_GetTick());
+	event_log_push(EVENT_TX_MAILBOX_ABORT, 1, 0);
+	Can_TxRefill(hcan);
 }
 
 void HAL_CAN_TxMailbox2AbortCallback(CAN_HandleTypeDef *hcan){
-	console_print("%.8lu TX (MBX=2) Abort!\r\n", HAL_GetTick());
+	event_log_push(EVENT_TX_MAILBOX_ABORT, 2, 0);
+	Can_TxRefill(hcan);
 }
 
 void HAL_CAN_SleepCallback(CAN_HandleTypeDef *hcan){
-	console_print("%.8lu Sleep Callback!\r\n", HAL_GetTick());
+	event_log_push(EVENT_CAN_SLEEP, 0, 0);
 }
 
 void HAL_CAN_WakeUpFromRxMsgCallback(CAN_HandleTypeDef *hcan){
-	console_print("%.8lu RX Wake-up Callback!\r\n", HAL_GetTick());
+	event_log_push(EVENT_CAN_WAKEUP, 0, 0);
 }
 
 /* USER CODE END 1 */
@@ -49,8 +49,6 @@
 /* USER CODE BEGIN PV */
 uint32_t pids_request_timer = 0;
 
-uint32_t pid_to_request = 0;
-
 uint32_t error_led_timer = 0;
 uint32_t can_packet_rx_led_timer = 0;
 /* USER CODE END PV */
@@ -126,7 +124,9 @@ int main(void)
   SystemClock_Config();
 
   /* USER CODE BEGIN SysInit */
+  timebase_init();
   console_init();
+  sniffer_init();
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
@@ -136,11 +136,15 @@ int main(void)
   MX_ADC1_Init();
   MX_IWDG_Init();
   /* USER CODE BEGIN 2 */
+  Can_MsInit();
+  uint32_t kbit[CAN_BUS_COUNT];
+  Can_AutoDetect(kbit);
   int32_t temperature = 0;
   int32_t acc = 0;
   adc_measure(ADC_TEMPERATURE_C, &temperature);
   adc_measure(ADC_VEHICLE_VOLTAGE, &acc);
   console_print("Device started! TEMP=%dC, VREF=%dmV, ACC=%dmV\r\n", temperature, adc_get_measured_vref(), acc);
+  console_print("AUTOBAUD HS=%lu MS=%lu MM=%lu\r\n", kbit[CAN_BUS_HS], kbit[CAN_BUS_MS], kbit[CAN_BUS_MM]);
   /* USER CODE END 2 */
 
   /* Infinite loop */
@@ -153,13 +157,14 @@ int main(void)
 //		  //console_print("CAN_STATE=%u\r\n", (uint16_t)HAL_CAN_GetState(&hcan2));
 //	  }
 
-	  if(pid_to_request){
-		  obd2_request_pid(pid_to_request);
-		  pid_to_request = 0;
-	  }
+	  obd2_main();
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
+	  sniffer_main();
+	  replay_main();
+	  Can_ErrorsMain();
+	  event_log_main();
 	  console_main();
 	  HAL_IWDG_Refresh(&hiwdg);
   }
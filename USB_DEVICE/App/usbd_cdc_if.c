@@ -262,10 +262,11 @@ static int8_t CDC_Control_FS(uint8_t cmd, uint8_t* pbuf, uint16_t length)
 static int8_t CDC_Receive_FS(uint8_t* Buf, uint32_t *Len)
 {
   /* USER CODE BEGIN 6 */
-	console_input(Buf, *Len);
-
-  USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &Buf[0]);
-  USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+	/* Endpoint NAKs the host until console_main() has room for another packet */
+	if(console_input(Buf, *Len)){
+		USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &Buf[0]);
+		USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+	}
   return (USBD_OK);
   /* USER CODE END 6 */
 }
@@ -286,7 +287,7 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
   uint8_t result = USBD_OK;
   /* USER CODE BEGIN 7 */
   USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
-  if (hcdc->TxState != 0){
+  if (hcdc == NULL || hcdc->TxState != 0){
     return USBD_BUSY;
   }
   USBD_CDC_SetTxBuffer(&hUsbDeviceFS, Buf, Len);
@@ -299,12 +300,21 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
 uint8_t CDC_Transmit_IsBusy(void){
 	USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
 
-	  if (hcdc->TxState != 0){
+	  /* Class data is not there until host configures the device */
+	  if (hcdc == NULL || hcdc->TxState != 0){
 		return USBD_BUSY;
 	  }
 
 	  return USBD_OK;
 }
+
+/* Re-arms OUT endpoint after CDC_Receive_FS() left it NAKing, caller must keep USB IRQ out */
+void CDC_Receive_Resume_FS(void){
+	if(hUsbDeviceFS.pClassData != NULL){
+		USBD_CDC_SetRxBuffer(&hUsbDeviceFS, UserRxBufferFS);
+		USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+	}
+}
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
 /**
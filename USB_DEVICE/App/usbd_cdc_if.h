@@ -109,6 +109,7 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len);
 
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
 uint8_t CDC_Transmit_IsBusy(void);
+void CDC_Receive_Resume_FS(void);
 /* USER CODE END EXPORTED_FUNCTIONS */
 
 /**